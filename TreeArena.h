@@ -0,0 +1,194 @@
+#ifndef _TREE_ARENA_H__
+#define _TREE_ARENA_H__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+/*TreeCode使用的内存池
+  按块向系统申请内存，分配时只移动块内偏移，单个对象不单独释放；
+  reset()把所有块标记为空闲但不还给系统，供下一条消息复用，
+  析构时才真正释放
+  */
+class TreeArena
+{
+    public:
+        enum
+        {
+            DEFAULT_BLOCK_SIZE = 16384,
+            ALIGN = 8,
+        };
+
+        explicit TreeArena(size_t blockSize = DEFAULT_BLOCK_SIZE)
+            :blockSize(blockSize < 256 ? 256 : blockSize),current(0),offset(0)
+        {
+
+        }
+
+        ~TreeArena()
+        {
+            for (size_t i=0;i<blocks.size();i++)
+            {
+                free(blocks[i].data);
+            }
+        }
+
+        //分配size字节，按ALIGN对齐，内存不足时返回NULL
+        void* alloc(size_t size)
+        {
+            size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+            while (current < blocks.size())
+            {
+                Block& b = blocks[current];
+                if (offset + size <= b.size)
+                {
+                    void* p = b.data + offset;
+                    offset += size;
+                    return p;
+                }
+                current++;
+                offset = 0;
+            }
+
+            //已有的块都放不下，申请新块；超大的分配独占一块
+            Block b;
+            b.size = size > blockSize ? size : blockSize;
+            b.data = (char*)malloc(b.size);
+            if (b.data == NULL)
+                return NULL;
+            blocks.push_back(b);
+            current = blocks.size() - 1;
+            offset = size;
+            return b.data;
+        }
+
+        /*保证接下来累计bytes字节（按ALIGN对齐后）的分配都在同一个块中完成，
+          当前块剩余的空间不够时换到足够大的空闲块或申请一个新块，当前块剩下的部分到reset前不再使用
+          \return 内存不足时返回false
+          */
+        bool reserve(size_t bytes)
+        {
+            if (current < blocks.size() && offset + bytes <= blocks[current].size)
+                return true;
+            size_t pos = (current < blocks.size() && offset > 0) ? current + 1 : current;
+            if (pos < blocks.size() && blocks[pos].size >= bytes)
+            {
+                current = pos;
+                offset = 0;
+                return true;
+            }
+
+            //插在后面的空闲块之前，它们仍然可以继续使用
+            Block b;
+            b.size = bytes > blockSize ? bytes : blockSize;
+            b.data = (char*)malloc(b.size);
+            if (b.data == NULL)
+                return false;
+            blocks.insert(blocks.begin() + pos,b);
+            current = pos;
+            offset = 0;
+            return true;
+        }
+
+        //回收全部分配，保留已申请的块
+        void reset()
+        {
+            current = 0;
+            offset = 0;
+        }
+
+        //p是否位于本arena的内存块中
+        bool owns(const void* p) const
+        {
+            const char* c = (const char*)p;
+            for (size_t i=0;i<blocks.size();i++)
+            {
+                if (c >= blocks[i].data && c < blocks[i].data + blocks[i].size)
+                    return true;
+            }
+            return false;
+        }
+
+        //已向系统申请的总字节数
+        size_t capacity() const
+        {
+            size_t total = 0;
+            for (size_t i=0;i<blocks.size();i++)
+                total += blocks[i].size;
+            return total;
+        }
+
+    private:
+        TreeArena(const TreeArena&);
+        TreeArena& operator=(const TreeArena&);
+
+        struct Block
+        {
+            char* data;
+            size_t size;
+        };
+
+        size_t blockSize;
+        vector<Block> blocks;
+        size_t current;//当前分配的块
+        size_t offset;//当前块已用字节
+};
+
+/*STL分配器，arena为NULL时退化为普通的new/delete，
+  否则从arena分配，deallocate不做任何事
+  */
+template<typename T>
+class ArenaAllocator
+{
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<typename U>
+            struct rebind
+            {
+                typedef ArenaAllocator<U> other;
+            };
+
+        ArenaAllocator(TreeArena* arena = NULL):arena(arena) {}
+        template<typename U>
+            ArenaAllocator(const ArenaAllocator<U>& other):arena(other.arena) {}
+
+        pointer address(reference r) const { return &r; }
+        const_pointer address(const_reference r) const { return &r; }
+
+        pointer allocate(size_type n, const void* = 0)
+        {
+            if (arena == NULL)
+                return (pointer)::operator new(n * sizeof(T));
+            void* p = arena->alloc(n * sizeof(T));
+            if (p == NULL)
+                throw std::bad_alloc();
+            return (pointer)p;
+        }
+
+        void deallocate(pointer p, size_type)
+        {
+            if (arena == NULL)
+                ::operator delete(p);
+        }
+
+        size_type max_size() const { return size_t(-1) / sizeof(T); }
+        void construct(pointer p, const T& v) { new((void*)p) T(v); }
+        void destroy(pointer p) { p->~T(); }
+
+        bool operator==(const ArenaAllocator& other) const { return arena == other.arena; }
+        bool operator!=(const ArenaAllocator& other) const { return arena != other.arena; }
+
+        TreeArena* arena;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef _TREE_BUFFER_H__
+#define _TREE_BUFFER_H__
+
+#include <new>
+#include <string.h>
+#include <boost/detail/atomic_count.hpp>
+#include "TreeCodeFormat.h"
+
+#ifndef TREECODE_BLOCK_MIN
+#define TREECODE_BLOCK_MIN 1024 //启用arena时，不小于这个长度的buffer内容放在可共享的TreeBlock中
+#endif
+
+/*引用计数的内存块，计数是原子的，可以在线程之间传递
+  create得到的块头部和内容一次分配；wrap包装外部内存（如收到的消息），最后一个引用释放时调用free
+  */
+class TreeBlock
+{
+    public:
+        typedef void (*FreeFunc)(void* data,void* ctx);
+
+        //新建len字节的块，引用计数为1
+        static TreeBlock* create(size_t len)
+        {
+            void* p = ::operator new(sizeof(TreeBlock) + len);
+            TreeBlock* b = new(p) TreeBlock(len,NULL,NULL);
+            b->p = (char*)(b + 1);
+            return b;
+        }
+
+        //包装外部内存，引用计数为1；free为NULL时不释放
+        static TreeBlock* wrap(void* data,size_t len,FreeFunc free,void* ctx)
+        {
+            TreeBlock* b = new(::operator new(sizeof(TreeBlock))) TreeBlock(len,free,ctx);
+            b->p = (char*)data;
+            return b;
+        }
+
+        void addRef()
+        {
+            ++refs;
+        }
+
+        void release()
+        {
+            if (--refs != 0)
+                return;
+            if (freeFunc != NULL)
+                freeFunc(p,ctx);
+            this->~TreeBlock();
+            ::operator delete(this);
+        }
+
+        char* data() const
+        {
+            return p;
+        }
+
+        size_t size() const
+        {
+            return len;
+        }
+
+        long refCount() const
+        {
+            return refs;
+        }
+
+    private:
+        TreeBlock(size_t len,FreeFunc free,void* ctx):refs(1),p(NULL),len(len),freeFunc(free),ctx(ctx)
+        {
+
+        }
+        TreeBlock(const TreeBlock&);
+        TreeBlock& operator=(const TreeBlock&);
+
+        boost::detail::atomic_count refs;
+        char* p;
+        size_t len;
+        FreeFunc freeFunc;
+        void* ctx;
+};
+
+/*TreeBlock中的一段，拷贝时只增加引用计数
+  Buffer节点的内容可以读成TreeBuffer，之后与节点、其他树和发送队列共享同一块内存，
+  节点释放后仍然有效；把TreeBuffer写入节点(setObj/addNode)同样不拷贝内容
+  */
+class TreeBuffer
+{
+    public:
+        TreeBuffer():block(NULL),p(NULL),len(0)
+        {
+
+        }
+
+        //新分配len字节，内容未初始化
+        explicit TreeBuffer(size_t len):block(NULL),p(NULL),len(0)
+        {
+            alloc(len);
+        }
+
+        //新分配并拷贝data
+        TreeBuffer(const void* data,size_t len):block(NULL),p(NULL),len(0)
+        {
+            alloc(len);
+            if (len > 0)
+                memcpy(p,data,len);
+        }
+
+        //引用block中从data开始的len字节，增加一次引用计数；block为NULL时data由调用者管理，写入节点时会拷贝
+        TreeBuffer(TreeBlock* block,const void* data,size_t len):block(block),p((char*)data),len(len)
+        {
+            if (block != NULL)
+                block->addRef();
+        }
+
+        TreeBuffer(const TreeBuffer& o):block(o.block),p(o.p),len(o.len)
+        {
+            if (block != NULL)
+                block->addRef();
+        }
+
+        TreeBuffer& operator=(const TreeBuffer& o)
+        {
+            TreeBuffer tmp(o);
+            swap(tmp);
+            return *this;
+        }
+
+        ~TreeBuffer()
+        {
+            reset();
+        }
+
+        //接管wrap得到的外部内存，例如直接在收到的消息上建立TreeCodeView后按slice取出buffer
+        static TreeBuffer wrap(void* data,size_t len,TreeBlock::FreeFunc free,void* ctx)
+        {
+            TreeBuffer b;
+            b.block = TreeBlock::wrap(data,len,free,ctx);
+            b.p = (char*)data;
+            b.len = len;
+            return b;
+        }
+
+        //共享同一块内存的一段，越界部分被截掉
+        TreeBuffer slice(size_t offset,size_t n) const
+        {
+            if (offset > len)
+                offset = len;
+            if (n > len - offset)
+                n = len - offset;
+            return TreeBuffer(block,p + offset,n);
+        }
+
+        //s在本段内部时返回对应的一段（如TreeCodeView读到的buffer内容），否则返回空
+        TreeBuffer slice(const TreeSlice& s) const
+        {
+            const char* d = s.c_str();
+            if (d < p || d > p + len || s.size() > (size_t)(p + len - d))
+                return TreeBuffer();
+            return TreeBuffer(block,d,s.size());
+        }
+
+        void reset()
+        {
+            if (block != NULL)
+                block->release();
+            block = NULL;
+            p = NULL;
+            len = 0;
+        }
+
+        void swap(TreeBuffer& o)
+        {
+            TreeBlock* b = block; block = o.block; o.block = b;
+            char* q = p; p = o.p; o.p = q;
+            size_t l = len; len = o.len; o.len = l;
+        }
+
+        char* data() const
+        {
+            return p;
+        }
+
+        size_t size() const
+        {
+            return len;
+        }
+
+        bool empty() const
+        {
+            return len == 0;
+        }
+
+        TreeBlock* getBlock() const
+        {
+            return block;
+        }
+
+    private:
+        void alloc(size_t n)
+        {
+            if (n == 0)
+                return;
+            block = TreeBlock::create(n);
+            p = block->data();
+            len = n;
+        }
+
+        TreeBlock* block;
+        char* p;
+        size_t len;
+};
+
+#endif
@@ -5,14 +5,23 @@
 #include <string>
 #include <assert.h>
 #include <fstream>
-#include <boost/any.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
 #include <stdint.h>
 #include <iostream>
+#include <limits>
+#include <stdio.h>
 #include "nType.h"
 #include "BinaryReader.h"
 #include "Stream.h"
 #include "BufferType.h"
+#include "TreeArena.h"
+#include "TreeBuffer.h"
+#include "TreeCodeFormat.h"
+#include "TreeCodeCompress.h"
+#include "TreeCodeFile.h"
+#include "TreeCodeStats.h"
 
 extern "C"
 {
@@ -23,8 +32,12 @@ extern "C"
 using namespace std;
 
 
+//解码时buffer和数组内容默认允许的最大字节数，每棵树可以用TreeCode::setMaxBufferLen修改
 #define MAX_BUFF_LEN 20480
 
+//解码时允许的最大树深度，防止异常数据
+#define TREECODE_MAX_DEPTH 1024
+
 typedef unsigned char byte;	
 
 /*Binary Extendable Code自定义的文件格式，二进制可扩展编码格式
@@ -44,6 +57,9 @@ typedef unsigned char byte;
 class Node
 {
     friend class TreeCode;
+    friend class TreeCodeDecoder;
+    friend class TreeCodeParallelLoader;
+    friend class TreeCodeDiff;
     public:
     enum TypeCode
     {
@@ -137,54 +153,321 @@ class Node
         //
         Pos2 = 25,
         //
+        // 摘要:
+        //     定长类型的数组，内容是连续存放的元素，编码为元素个数+全部元素。
+        Int32Array = 32,
+        Int64Array = 33,
+        SingleArray = 34,
+        DoubleArray = 35,
+        Vector2Array = 36,
+        Vector3Array = 37,
+        Pos2Array = 38,
+    };
+    //节点名称和子节点列表，有arena时从arena分配
+    typedef basic_string<char, char_traits<char>, ArenaAllocator<char> > NodeString;
+    typedef vector<Node*, ArenaAllocator<Node*> > NodeList;
+
+    explicit Node(TreeArena* arena = NULL)
+        :name(ArenaAllocator<char>(arena)),type(Empty),dirty(true),sons(ArenaAllocator<Node*>(arena)),parent(NULL),arena(arena),treeSize(0),nameIndex(0),cacheOffset(0),cacheLen(0),index(NULL)
+    {
+
+    }
+
+    //创建节点，arena不为NULL时节点本身也放在arena中
+    static Node* create(TreeArena* arena)
+    {
+        TREECODE_STAT_ADD(TC_STAT_NODES_CREATED,1);
+        if (arena == NULL)
+            return new Node();
+        void* p = arena->alloc(sizeof(Node));
+        if (p == NULL)
+            return NULL;
+        return new(p) Node(arena);
+    }
+
+    /*释放create得到的节点及其子树，不递归；arena中的内存留给arena整体回收
+      stack用来暂存待释放的节点，可以重复使用
+      */
+    static void destroy(Node* node,vector<Node*>& stack)
+    {
+        if (node == NULL)
+            return;
+        stack.clear();
+        stack.push_back(node);
+        while (!stack.empty())
+        {
+            Node* n = stack.back();
+            stack.pop_back();
+            if (n == NULL)//并行解码失败时可能有还没填上的子节点
+                continue;
+            stack.insert(stack.end(),n->sons.begin(),n->sons.end());
+            n->sons.clear();
+            if (n->arena == NULL)
+                delete n;
+            else
+                n->~Node();
+        }
+    }
+
+    static void destroy(Node* node)
+    {
+        vector<Node*> stack;
+        destroy(node,stack);
+    }
+
+    //非递归复制以src为根的子树（名称、内容和所有子节点），新节点从arena分配
+    static Node* clone(const Node* src,TreeArena* arena,vector<pair<const Node*,Node*> >& stack)
+    {
+        Node* root = create(arena);
+        stack.clear();
+        stack.push_back(make_pair(src,root));
+        while (!stack.empty())
+        {
+            const Node* s = stack.back().first;
+            Node* d = stack.back().second;
+            stack.pop_back();
+            d->name.assign(s->name.data(),s->name.size());
+            d->copyValue(*s);
+            d->sons.resize(s->sons.size(),NULL);
+            for (unsigned int i=0;i<s->sons.size();i++)
+            {
+                Node* n = create(arena);
+                n->parent = d;
+                d->sons[i] = n;
+                stack.push_back(make_pair((const Node*)s->sons[i],n));
+            }
+        }
+        return root;
+    }
+
+    //非递归遍历时的栈帧
+    struct Frame
+    {
+        Node* node;
+        unsigned int next;//下一个要处理的子节点；解码时是还没读取的子节点数量
+        Frame(Node* node,unsigned int next):node(node),next(next) {}
+    };
+    typedef vector<Frame> WorkStack;
+
+    struct SliceHash
+    {
+        size_t operator()(const TreeSlice& s) const { return boost::hash_range(s.data,s.data + s.len); }
     };
+    struct SliceEqual
+    {
+        bool operator()(const TreeSlice& a,const TreeSlice& b) const { return a.equals(b.c_str(),b.len); }
+    };
+
+    /*TC_FLAG_NAME_TABLE的名称表：消息头之后先写不同名称的个数(变长整数)和每个名称(1字节长度+内容)，
+      之后每个节点的名称只写序号(变长整数)
+      */
+    struct NameTable
+    {
+        typedef boost::unordered_map<TreeSlice,unsigned int,SliceHash,SliceEqual> IdMap;
+        IdMap ids;//编码用：名称到序号，key指向节点自己的name
+        vector<TreeSlice> order;//编码用：按序号排列的名称
+        vector<string> names;//解码用：每个名称只构造一次
+
+        void clear()
+        {
+            ids.clear();
+            order.clear();
+            names.clear();
+        }
+    };
+
+    //scan的结果：整条消息的规模，用于解码前一次预先分配
+    struct ScanResult
+    {
+        size_t nodes;//节点数
+        size_t nameBytes;//所有节点名称的总字节数
+        size_t stringBytes;//UTF8String内容的总字节数
+        size_t valueBytes;//buffer和数组内容的总字节数，不含超过长度限制、解码为空的内容
+        unsigned int depth;//最大深度，只有根节点时为0
+        size_t used;//消息占用的字节数（包括消息头），之后的数据不属于这条消息
+        size_t arenaBytes;//启用arena时解码要从arena分配的字节数（估算）
+
+        ScanResult()
+        {
+            clear();
+        }
+
+        void clear()
+        {
+            nodes = nameBytes = stringBytes = valueBytes = used = arenaBytes = 0;
+            depth = 0;
+        }
+    };
+
+    //scan的栈帧：还没检查的子节点数量，带子树长度时还有子树的结束位置
+    struct ScanFrame
+    {
+        unsigned int left;
+        const unsigned char* end;
+        ScanFrame(unsigned int left,const unsigned char* end):left(left),end(end) {}
+    };
+
+    //scan用的临时空间，可以重复使用
+    struct ScanBuffer
+    {
+        vector<ScanFrame> stack;
+        vector<unsigned char> nameLens;//名称表中每个名称的长度
+    };
+
     ~Node()
     {		
-        if(type == Buffer)
+        releaseBuffer();
+        clearValue();
+        delete index;
+        //通过destroy释放时子节点已经取走，这里只处理直接delete的情况
+        for (unsigned int i=0;i<sons.size();i++)
         {
-           buffer_t buff=boost::any_cast<buffer_t>(obj);				
-           if(buff.type == 0 && buff.len > 0 && buff.p != NULL){
-               byte* p = (byte*)buff.p;
-               delete[] p;
-               buff.p = NULL;
-               buff.len = 0;
-           }
+            destroy(sons[i]);
+        }
+    }
+
+    enum { INDEX_MIN_SONS = 16 };//子节点达到这个数量后按名称查找时建立索引
 
+    //按名称找子节点，同名时返回第一个
+    Node* findSon(const char* sonName,size_t len)
+    {
+        if (sons.size() >= INDEX_MIN_SONS)
+        {
+            if (index == NULL)
+                buildIndex();
+            SonIndex::const_iterator it = index->find(TreeSlice(sonName,len));
+            return it == index->end() ? NULL : it->second;
         }
         for (unsigned int i=0;i<sons.size();i++)
         {
-            delete(sons[i]);
+            const NodeString& s = sons[i]->name;
+            if (s.size() == len && s.compare(0,len,sonName,len) == 0)
+                return sons[i];
         }
+        return NULL;
+    }
+
+    //添加子节点，son的名称需要已经设置好
+    void addSon(Node* son)
+    {
+        sons.push_back(son);
+        son->parent = this;
+        markDirty();
+        if (index != NULL)
+            index->insert(make_pair(TreeSlice(son->name.data(),son->name.size()),son));
     }
 
 
+    /*标记节点和所有祖先的编码缓存失效，见TreeCode::enableEncodeCache
+      setObj和addSon会自动调用；通过as<T>()直接修改内容或修改buffer指向的数据后需要手动调用
+      */
+    void markDirty()
+    {
+        //祖先一定比子孙先失效，遇到已失效的节点就可以停止
+        for (Node* n = this; n != NULL && !n->dirty; n = n->parent)
+            n->dirty = true;
+    }
+
     void setEmptyObj()
     {
+        markDirty();
+        clearValue();
         type = Empty;
-        this->obj = string("null");
     }
 
     void setObj(const char* obj)
     {
-        setObj(string(obj));
+        markDirty();
+        clearValue();
+        type = UTF8String;
+        new(&value) NodeString(obj,ArenaAllocator<char>(arena));
     }
 
     void setObj(char obj){
+        markDirty();
+        clearValue();
         type = SByte;
-        this->obj = obj;
+        store(obj);
     }
 
     void setObj(unsigned char obj){
         //printf("set unsigned char---%u\n",obj);
+        markDirty();
+        clearValue();
         type = Byte;
-        this->obj = obj;
+        store(obj);
     }
 
     template<typename T>
         void setObj(const T& obj)
         {
-            type = GetTypeCode(obj);			
-            this->obj = obj;
+            markDirty();
+            clearValue();
+            put(obj);
+        }
+
+    /*按类型读取节点内容，类型不匹配时返回false
+      Empty节点按字符串读取时得到"null"
+      */
+#define GET_VALUE(T,E) bool get(T& v) const {if(type != E) return false; v = as<T>(); return true;}
+#define GET_VALUE2(T,E1,E2) bool get(T& v) const {if(type != E1 && type != E2) return false; v = as<T>(); return true;}
+    GET_VALUE(bool,Boolean)	GET_VALUE2(char,SByte,Byte)	GET_VALUE2(unsigned char,Byte,SByte)	GET_VALUE(short,Int16)	GET_VALUE2(unsigned short,UInt16,WChar)
+        GET_VALUE(int,Int32)	GET_VALUE(unsigned int,UInt32)	GET_VALUE(int64_t,Int64)	GET_VALUE(uint64_t,UInt64)	GET_VALUE(float,Single)
+        GET_VALUE(double,Double)	GET_VALUE(buffer_t,Buffer)	GET_VALUE(float2,Vector2)	GET_VALUE(float3,Vector3)	GET_VALUE(pos2,Pos2)
+
+    //数组：TreeSpan直接指向节点中的元素，vector会拷贝
+#define GET_ARRAY(T,E) bool get(TreeSpan<T>& v) const {if(type != E) return false; const ArrayValue& a = as<ArrayValue>(); v = TreeSpan<T>((const T*)a.p,a.count); return true;}
+    GET_ARRAY(int,Int32Array)	GET_ARRAY(int64_t,Int64Array)	GET_ARRAY(float,SingleArray)	GET_ARRAY(double,DoubleArray)
+        GET_ARRAY(float2,Vector2Array)	GET_ARRAY(float3,Vector3Array)	GET_ARRAY(pos2,Pos2Array)
+
+    /*Buffer读成TreeBuffer：内容在TreeBlock中时只增加引用计数，节点释放后仍然有效；
+      在arena中或由外部设置的buffer_t会拷贝一份
+      */
+    bool get(TreeBuffer& v) const
+    {
+        if (type != Buffer)
+            return false;
+        const BufferValue& b = as<BufferValue>();
+        if (b.block != NULL)
+            v = TreeBuffer(b.block,b.buff.p,b.buff.len);
+        else if (b.buff.p != NULL && b.buff.len > 0)
+            v = TreeBuffer(b.buff.p,b.buff.len);
+        else
+            v.reset();
+        return true;
+    }
+
+    template<typename T>
+        bool get(vector<T>& v) const
+        {
+            TreeSpan<T> s;
+            if (!get(s))
+                return false;
+            v.assign(s.begin(),s.end());
+            return true;
+        }
+
+    bool get(string& v) const
+    {
+        if (type == UTF8String)
+        {
+            const NodeString& s = as<NodeString>();
+            v.assign(s.data(),s.size());
+            return true;
+        }
+        if (type == Empty)
+        {
+            v = "null";
+            return true;
+        }
+        return false;
+    }
+
+    //不支持的类型
+    template<typename T>
+        bool get(T& v) const
+        {
+            return false;
         }
 
     static string readString(istream& stream)
@@ -216,245 +499,1032 @@ class Node
         stream.write((char*)str.c_str(),str.size());
     }
 
+    /*Buffer类型的内容：block不为NULL时内容在block中，节点持有一次引用；
+      否则按buffer_t原来的规则，type为0且不在arena中的内容由节点delete[]
+      */
+    struct BufferValue
+    {
+        buffer_t buff;
+        TreeBlock* block;
+    };
+
+    //数组类型的内容，元素由节点拥有，有arena时从arena分配
+    struct ArrayValue
+    {
+        void* p;
+        unsigned int count;
+    };
+
+    //数组元素的字节数，不是数组时返回0
+    static unsigned int elemSize(TypeCode type)
+    {
+        switch(type)
+        {
+            case Int32Array:    return sizeof(int);
+            case Int64Array:    return sizeof(int64_t);
+            case SingleArray:   return sizeof(float);
+            case DoubleArray:   return sizeof(double);
+            case Vector2Array:  return sizeof(float2);
+            case Vector3Array:  return sizeof(float3);
+            case Pos2Array:     return sizeof(pos2);
+            default:            return 0;
+        }
+    }
+
+    static bool isArrayType(TypeCode type)
+    {
+        return elemSize(type) != 0;
+    }
+
+    /*内容的编码长度：定长类型返回字节数，UTF8String、Buffer和数组(4字节长度+内容)返回-1，没有内容的类型返回0
+      数组的长度字段是元素个数
+      */
+    static int valueSize(TypeCode type)
+    {
+        switch(type)
+        {
+            case Boolean:       return sizeof(bool);
+            case WChar:         return sizeof(unsigned short);
+            case Byte:          return sizeof(unsigned char);
+            case SByte:         return sizeof(unsigned char);
+            case Int16:         return sizeof(short);
+            case UInt16:        return sizeof(unsigned short);
+            case Int32:         return sizeof(int);
+            case UInt32:        return sizeof(unsigned int);
+            case Int64:         return sizeof(int64_t);
+            case UInt64:        return sizeof(uint64_t);
+            case Single:        return sizeof(float);
+            case Double:        return sizeof(double);
+            case UTF8String:    return -1;
+            case Buffer:        return -1;
+            case Int32Array:    return -1;
+            case Int64Array:    return -1;
+            case SingleArray:   return -1;
+            case DoubleArray:   return -1;
+            case Vector2Array:  return -1;
+            case Vector3Array:  return -1;
+            case Pos2Array:     return -1;
+            case Vector2:       return sizeof(float2);
+            case Vector3:       return sizeof(float3);
+            case Pos2:          return sizeof(pos2);
+            default:            return 0;
+        }
+    }
+
+    /*编码器能写出的类型，其余的类型码说明数据不合法
+      参数是消息中的原始字节，检查通过后才能转成TypeCode
+      */
+    static bool isKnownType(unsigned int type)
+    {
+        return type == Empty || (type >= Boolean && type <= Double) || (type >= UTF8String && type <= Vector3)
+            || type == Pos2 || (type >= Int32Array && type <= Pos2Array);
+    }
+
+    //TC_FLAG_VARINT时内容用变长编码的类型
+    static bool isVarintType(TypeCode type)
+    {
+        return type == Int32 || type == UInt32 || type == Int64 || type == UInt64;
+    }
+
+    //把src处type类型的整数转成变长编码前的无符号数，有符号数做zigzag
+    static uint64_t toVarint(TypeCode type,const void* src)
+    {
+        int i32;unsigned int u32;int64_t i64;uint64_t u64;
+        switch(type)
+        {
+            case Int32:     memcpy(&i32,src,sizeof(i32));   return zigzagEncode(i32);
+            case UInt32:    memcpy(&u32,src,sizeof(u32));   return u32;
+            case Int64:     memcpy(&i64,src,sizeof(i64));   return zigzagEncode(i64);
+            default:        memcpy(&u64,src,sizeof(u64));   return u64;
+        }
+    }
+
+    //toVarint的逆过程，按type的原生格式写到dst
+    static void fromVarint(TypeCode type,uint64_t v,void* dst)
+    {
+        int i32;unsigned int u32;int64_t i64;
+        switch(type)
+        {
+            case Int32:     i32 = (int)zigzagDecode(v);     memcpy(dst,&i32,sizeof(i32));   break;
+            case UInt32:    u32 = (unsigned int)v;          memcpy(dst,&u32,sizeof(u32));   break;
+            case Int64:     i64 = zigzagDecode(v);          memcpy(dst,&i64,sizeof(i64));   break;
+            default:        memcpy(dst,&v,sizeof(v));       break;
+        }
+    }
+
     private:
 #define GET_TYPE(T,E) TypeCode GetTypeCode(T v){return E;}
     GET_TYPE(bool,Boolean)	GET_TYPE(char,Byte)	GET_TYPE(byte,Byte)	GET_TYPE(short,Int16)	GET_TYPE(unsigned short,UInt16)	GET_TYPE(int,Int32)	
         GET_TYPE(unsigned int,UInt32)	GET_TYPE(int64_t,Int64)	GET_TYPE(uint64_t,UInt64)	GET_TYPE(float,Single)	GET_TYPE(double,Double)	
         GET_TYPE(const string&,UTF8String)	GET_TYPE(buffer_t,Buffer)	GET_TYPE(float2,Vector2)	GET_TYPE(float3,Vector3) GET_TYPE(pos2,Pos2)
 
+#define PUT_TYPE(T,E) void put(T v){type=E;store(v);}
+    PUT_TYPE(bool,Boolean)	PUT_TYPE(short,Int16)	PUT_TYPE(unsigned short,UInt16)	PUT_TYPE(int,Int32)	
+        PUT_TYPE(unsigned int,UInt32)	PUT_TYPE(int64_t,Int64)	PUT_TYPE(uint64_t,UInt64)	PUT_TYPE(float,Single)	PUT_TYPE(double,Double)	
+        PUT_TYPE(float2,Vector2)	PUT_TYPE(float3,Vector3) PUT_TYPE(pos2,Pos2)
 
+    //节点接管buffer_t的内容，规则见BufferValue
+    void put(buffer_t v)
+    {
+        type = Buffer;
+        BufferValue b;
+        b.buff = v;
+        b.block = NULL;
+        store(b);
+    }
 
-        void load(istream& stream)
-        {		
-            byte nameLen=0;
-            stream.read((char*)&nameLen,sizeof(nameLen));			
-
-            char* p=new char[nameLen+1];				
-            stream.read((char*)p,nameLen);			
-            p[nameLen]=0;
-            name=p;
-            delete[] p;			
-            p= NULL;
-
-            byte tmpByte;
-            stream.read((char*)&tmpByte,sizeof(tmpByte));			
-            type=(TypeCode)tmpByte;
-
-            //根据类型采取不同读取方式
-#define ISTREAM_READ_TYPE(T) {T tmp;stream.read((char*)&tmp,sizeof(tmp));obj=tmp;}
-            switch(type)
-            {				
-                case Empty:     obj=string("null"); break;
-                case Boolean:				ISTREAM_READ_TYPE(bool);				break;
-                case WChar:				ISTREAM_READ_TYPE(unsigned short);				break;
-                case Byte:				ISTREAM_READ_TYPE(unsigned char);				break;
-                case SByte:				ISTREAM_READ_TYPE(unsigned char);				break;
-                case Int16:				ISTREAM_READ_TYPE(short);				break;
-                case UInt16:				ISTREAM_READ_TYPE(unsigned short);				break;
-                case Int32:				ISTREAM_READ_TYPE(int);				break;
-                case UInt32:				ISTREAM_READ_TYPE(unsigned int);				break;
-                case Int64:				ISTREAM_READ_TYPE(int64_t);				break;
-                case UInt64:				ISTREAM_READ_TYPE(uint64_t);				break;
-                case Single:				ISTREAM_READ_TYPE(float);				break;
-                case Double:				ISTREAM_READ_TYPE(double);				break;
-                case UTF8String:				obj=readString(stream);						break;				
-                case Buffer:
-                                                {
-                                                buffer_t buff;				
-                                                stream.read((char*)&buff.len,sizeof(buff.len));						
-                                                buff.p=new byte[buff.len];
-                                                stream.read((char*)buff.p,buff.len);						
-                                                obj=buff;
-                                                }
-                                                break;
-                case Vector2:				ISTREAM_READ_TYPE(float2);				break;
-                case Vector3:				ISTREAM_READ_TYPE(float3);				break;
-                case Pos2:                  ISTREAM_READ_TYPE(pos2);   break;
-                default:	
-#ifdef DEBUG_PRINT
-                                            printf("not expected typecode:%d\n",type);
-#endif
-                                            assert(!"not expected typecode");
-                                            break;
-            }		
+    //共享TreeBuffer的内容，不拷贝；不属于任何TreeBlock的内容由调用者管理，只能拷贝
+    void put(const TreeBuffer& v)
+    {
+        if (v.getBlock() == NULL)
+        {
+            storeBuffer(v.data(),v.size());
+            return;
+        }
+        type = Buffer;
+        BufferValue b;
+        b.buff = buffer_t();
+        b.buff.len = v.size();
+        b.buff.p = v.data();
+        b.buff.type = 0;
+        b.block = v.getBlock();
+        b.block->addRef();
+        store(b);
+    }
 
-            unsigned short num = 0;
-            stream.read((char*)&num,sizeof(num));			
-            //printf("node[%s] have sons[%u]\n",name.c_str(),num);
-            for (unsigned short i = 0; i < num; i++)
+    /*分配len字节的buffer内容，src不为NULL时拷贝
+      启用arena时小的内容放在arena中，其余放在TreeBlock中，之后读成TreeBuffer时不再拷贝
+      */
+    void storeBuffer(const void* src,unsigned int len)
+    {
+        type = Buffer;
+        BufferValue b;
+        b.buff = buffer_t();
+        b.buff.len = len;
+        b.buff.p = NULL;
+        b.buff.type = 0;
+        b.block = NULL;
+        if (len > 0)
+        {
+            if (arena != NULL && len < TREECODE_BLOCK_MIN)
+                b.buff.p = arena->alloc(len);
+            else
             {
-                Node* n = new Node();
-                sons.push_back(n);
-                n->parent = this;
-                n->load(stream);
+                b.block = TreeBlock::create(len);
+                b.buff.p = b.block->data();
             }
+            if (src != NULL)
+                memcpy(b.buff.p,src,len);
         }
+        store(b);
+    }
 
+    void put(const string& v)
+    {
+        type = UTF8String;
+        new(&value) NodeString(v.data(),v.size(),ArenaAllocator<char>(arena));
+    }
 
+    //数组，元素整块拷贝
+#define PUT_ARRAY(T,E) void put(const TreeSpan<T>& v){type=E;storeArray(v.data,v.size());}
+    PUT_ARRAY(int,Int32Array)	PUT_ARRAY(int64_t,Int64Array)	PUT_ARRAY(float,SingleArray)	PUT_ARRAY(double,DoubleArray)
+        PUT_ARRAY(float2,Vector2Array)	PUT_ARRAY(float3,Vector3Array)	PUT_ARRAY(pos2,Pos2Array)
 
-        void load(void* data,unsigned int len)
+    template<typename T>
+        void put(const vector<T>& v)
         {
-            BinaryReader stream(data,len,false);
-            load(stream);
+            put(TreeSpan<T>(v.empty() ? NULL : &v[0],v.size()));
         }
 
-        //load
-        void load(BinaryReader& stream)
-        {
-            UInt8 nameLen = 0;
-            UInt8 intType = 0;
-            stream >> nameLen;
-            name.resize(nameLen);
-            stream.read(name,nameLen);
-            //printf("###1:pos:%u\n",stream.pos());
-            stream >> intType;
-            type = (TypeCode) intType;
-            //printf("###2:pos:%u\n",stream.pos());
+    void* allocArray(size_t bytes)
+    {
+        if (bytes == 0)
+            return NULL;
+        if (arena != NULL)
+            return arena->alloc(bytes);
+        return ::operator new(bytes);
+    }
 
-#define READ_TYPE(T) {T tmp; stream >> tmp; obj = tmp;}
+    //按当前type存放count个元素，src为NULL时只分配
+    void storeArray(const void* src,unsigned int count)
+    {
+        size_t bytes = (size_t)count * elemSize(type);
+        ArrayValue a;
+        a.count = count;
+        a.p = allocArray(bytes);
+        if (src != NULL && bytes > 0)
+            memcpy(a.p,src,bytes);
+        store(a);
+    }
 
-            switch(type)
-            {				
-                case Empty:            
-             //       printf("empty---------\n");
-                    obj=string("null"); break;
-                case Boolean:		   READ_TYPE(bool);				break;
-                case WChar:			   READ_TYPE(unsigned short);				break;
-                case Byte:			   READ_TYPE(unsigned char);				break;
-                case SByte:			   READ_TYPE(unsigned char);				break;
-                case Int16:			   READ_TYPE(short);				break;
-                case UInt16:		   READ_TYPE(unsigned short);				break;
-                case Int32:			   READ_TYPE(int);				break;
-                case UInt32:		   READ_TYPE(unsigned int);				break;
-                case Int64:			   READ_TYPE(int64_t);				break;
-                case UInt64:		   READ_TYPE(uint64_t);				break;
-                case Single:		   READ_TYPE(float);				break;
-                case Double:		   READ_TYPE(double);				break;
-                case UTF8String:	   
-                                       {
-                                           std::string tmp;
-                                           stream.readString32(tmp);
-                                           obj = tmp;
-                                       }
-                                       break;				
-                case Buffer:           
-                                       {
-                                           buffer_t tmp;				
-                                           stream.read((unsigned char*)&tmp.len,sizeof(tmp.len));						
-                                           if(tmp.len > MAX_BUFF_LEN or tmp.len < 1)
-                                           {
-                                               ERROR_LOG("buffer len > MAX_BUFF(%u) or buffer is null,len is [%u]",MAX_BUFF_LEN,tmp.len);
-                                               DEBUG_LOG("buffer len > MAX_BUFF(%u) or buffer is null,len is [%u]",MAX_BUFF_LEN,tmp.len);
-                                               tmp.len = 0;
-                                               tmp.p = NULL;
-                                               obj = tmp;
-                                               break;
-                                           }
-                                           tmp.p=new byte[tmp.len];
-                                           stream.read((unsigned char*)tmp.p,tmp.len);						
-                                           this->obj=tmp;
+    //按当前type原地存放内容，不改变type
+    template<typename T>
+        void store(const T& v)
+        {
+            new(&value) T(v);
+        }
 
-                                           buffer_t a;
-                                           a = boost::any_cast<buffer_t>(obj);
-                                           //DEBUG_LOG("tree read buffer,buff_len[%u]",a.len);
-                                       }
-                                       break;
-                case Vector2:		   READ_TYPE(float2);				break;
-                case Vector3:		   READ_TYPE(float3);				break;
-                case Pos2:		       READ_TYPE(pos2);				break;
-                default:	
-#ifdef DEBUG_PRINT
-                                       DEBUG_LOG("not expected typecode:%d",type);
-#endif
-                                       //assert(!"not expected typecode");
-                                       break;
-            }
-            unsigned short num = 0;
-            stream >> num;
-            //num = ntohs(num);
-            //printf("pos[%u],node[%s]---sons num:[%u]\n",stream.pos(),name.c_str(),num);
-            for (unsigned short i = 0; i < num; i++)
-            {
-                Node* n = new Node();
-                sons.push_back(n);
-                n->parent = this;
-                n->load(stream);
-            }
+    template<typename T>
+        T& as()
+        {
+            return *reinterpret_cast<T*>(&value);
+        }
+
+    template<typename T>
+        const T& as() const
+        {
+            return *reinterpret_cast<const T*>(&value);
         }
 
-    void save(ostream& stream)
+    //释放字符串、数组内容和TreeBlock的引用，buffer_t的所有权不变
+    void clearValue()
     {
-        assert(((name.size() < 65536) || !"node's name is too long to save name"));
+        if (type == UTF8String)
+            as<NodeString>().~NodeString();
+        else if (isArrayType(type) && arena == NULL)
+            ::operator delete(as<ArrayValue>().p);
+        else if (type == Buffer && as<BufferValue>().block != NULL)
+            as<BufferValue>().block->release();
+        type = Empty;
+    }
 
-        byte tmp=name.size();
-        stream.write((char*)&tmp,sizeof(tmp));			
-        stream.write((char*)name.c_str(),name.size());
+    /*节点自身在arena之外占用的字节数（不含子节点），名称和字符串按capacity估算
+      TreeBlock按引用它的节点各计一次；用户传入的buffer_t不属于节点，不计入
+      */
+    size_t heapSize() const
+    {
+        size_t size = 0;
+        if (arena == NULL)
+        {
+            size += sizeof(Node) + name.capacity() + sons.capacity() * sizeof(Node*);
+            if (type == UTF8String)
+                size += as<NodeString>().capacity();
+            else if (isArrayType(type))
+                size += (size_t)as<ArrayValue>().count * elemSize(type);
+        }
+        if (type == Buffer)
+        {
+            const BufferValue& b = as<BufferValue>();
+            if (b.block != NULL)
+                size += sizeof(TreeBlock) + b.block->size();
+            else if (b.buff.type == 0 && b.buff.p != NULL && (arena == NULL || !arena->owns(b.buff.p)))
+                size += b.buff.len;
+        }
+        if (index != NULL)
+            size += sizeof(SonIndex) + index->bucket_count() * sizeof(void*) + index->size() * (sizeof(SonIndex::value_type) + sizeof(void*));
+        return size;
+    }
 
-        byte tmpByte=type;
-        stream.write((char*)&tmpByte,sizeof(tmpByte));
+    //释放节点拥有的buffer（buffer_t::type为0且不在arena或TreeBlock中），与析构时的规则相同
+    void releaseBuffer()
+    {
+        if(type == Buffer && as<BufferValue>().block == NULL)
+        {
+           buffer_t& buff=as<buffer_t>();
+           if(buff.type == 0 && buff.len > 0 && buff.p != NULL && (arena == NULL || !arena->owns(buff.p))){
+               byte* p = (byte*)buff.p;
+               delete[] p;
+               buff.p = NULL;
+               buff.len = 0;
+           }
 
-        //根据类型采取不同写入方式
-        buffer_t buff;
-#define WRITE_TYPE(T) {T tmp=boost::any_cast<T>(obj);stream.write((char*)&tmp,sizeof(tmp));}
-        switch(type)
-        {				
-            case Empty:              break; //write nothing
-            case Boolean:				WRITE_TYPE(bool);				break;
-            case WChar:				WRITE_TYPE(unsigned short);				break;
-            case Byte:				WRITE_TYPE(unsigned char);				break;
-            case SByte:				WRITE_TYPE(unsigned char);				break;
-            case Int16:				WRITE_TYPE(short);				break;
-            case UInt16:				WRITE_TYPE(unsigned short);				break;
-            case Int32:				WRITE_TYPE(int);				break;
-            case UInt32:				WRITE_TYPE(unsigned int);				break;
-            case Int64:				WRITE_TYPE(int64_t);				break;
-            case UInt64:				WRITE_TYPE(uint64_t);				break;
-            case Single:				WRITE_TYPE(float);				break;
-            case Double:				WRITE_TYPE(double);				break;
-            case UTF8String:				writeString(stream,boost::any_cast<string>(obj));						break;				
-            case Buffer:
-                                            {
-                                            buff=boost::any_cast<buffer_t>(obj);				
-                                            stream.write((char*)&buff.len,sizeof(buff.len));										
-                                            if(buff.len > 0 && buff.p != NULL)
-                                                stream.write((char*)buff.p,buff.len);
-                                            }
-                                            break;
-            case Vector2:				WRITE_TYPE(float2);				break;
-            case Vector3:				WRITE_TYPE(float3);				break;
-            case Pos2:				WRITE_TYPE(pos2);				break;
-            default:	
+        }
+    }
+
+    //类型和内容是否相同，不比较名称和子节点
+    bool sameValue(const Node& o) const
+    {
+        if (type != o.type)
+            return false;
+        int size = valueSize(type);
+        if (size >= 0)
+            return memcmp(&value,&o.value,size) == 0;
+        if (type == UTF8String)
+            return as<NodeString>() == o.as<NodeString>();
+        if (isArrayType(type))
+        {
+            const ArrayValue& a = as<ArrayValue>();
+            const ArrayValue& b = o.as<ArrayValue>();
+            return a.count == b.count && (a.count == 0 || memcmp(a.p,b.p,(size_t)a.count * elemSize(type)) == 0);
+        }
+        const buffer_t& a = as<buffer_t>();
+        const buffer_t& b = o.as<buffer_t>();
+        if (a.len != b.len)
+            return false;
+        return a.len == 0 || a.p == b.p || (a.p != NULL && b.p != NULL && memcmp(a.p,b.p,a.len) == 0);
+    }
+
+    //复制src的类型和内容，字符串和数组拷贝一份由本节点拥有，TreeBlock中的buffer共享
+    void copyValue(const Node& src)
+    {
+        markDirty();
+        releaseBuffer();
+        clearValue();
+        type = src.type;
+        int size = valueSize(type);
+        if (size >= 0)
+            memcpy(&value,&src.value,size);
+        else if (type == UTF8String)
+            new(&value) NodeString(src.as<NodeString>().data(),src.as<NodeString>().size(),ArenaAllocator<char>(arena));
+        else if (isArrayType(type))
+            storeArray(src.as<ArrayValue>().p,src.as<ArrayValue>().count);
+        else
+        {
+            const BufferValue& s = src.as<BufferValue>();
+            if (s.block != NULL)
+                put(TreeBuffer(s.block,s.buff.p,s.buff.len));
+            else
+                storeBuffer(s.buff.p,(s.buff.p != NULL) ? s.buff.len : 0);
+        }
+    }
+
+
+
+        template<typename T>
+            static void readFixed(istream& stream,T& v)
+            {
+                stream.read((char*)&v,sizeof(v));
+            }
+
+        template<typename T>
+            static void readFixed(BinaryReader& stream,T& v)
+            {
+                stream >> v;
+            }
+
+        //逐字节读一个变长整数，最多10字节
+        template<typename S>
+            static uint64_t readVarint(S& stream)
+            {
+                uint64_t v = 0;
+                for (unsigned int i=0;i<TREECODE_VARINT_MAX;i++)
+                {
+                    unsigned char b = 0;
+                    readFixed(stream,b);
+                    v |= (uint64_t)(b & 0x7F) << (7*i);
+                    if (b < 0x80)
+                        break;
+                }
+                return v;
+            }
+
+        //字符串和buffer的长度
+        template<typename S>
+            static unsigned int readLength(S& stream,unsigned char flags)
+            {
+                if (flags & TC_FLAG_VARINT)
+                    return (unsigned int)readVarint(stream);
+                unsigned int len = 0;
+                readFixed(stream,len);
+                return len;
+            }
+
+        template<typename S>
+            static unsigned short readSonNum(S& stream,unsigned char flags)
+            {
+                if (flags & TC_FLAG_VARINT)
+                    return (unsigned short)readVarint(stream);
+                unsigned short num = 0;
+                readFixed(stream,num);
+                return num;
+            }
+
+        //读取名称表，数据不合法时返回false
+        template<typename S>
+            static bool readNameTable(S& stream,NameTable& table)
+            {
+                table.clear();
+                uint64_t count = readVarint(stream);
+                if (count > TREECODE_MAX_NAMES)
+                {
+                    ERROR_LOG("treecode name table too large[%u]",(unsigned int)count);
+                    return false;
+                }
+                table.names.resize(count);
+                for (unsigned int i=0;i<count;i++)
+                {
+                    unsigned char len = 0;
+                    readFixed(stream,len);
+                    string& s = table.names[i];
+                    s.resize(len);
+                    if (len > 0)
+                        readBytes(stream,&s[0],len);
+                }
+                return true;
+            }
+
+        static void readBytes(istream& stream,char* p,size_t n)
+        {
+            stream.read(p,n);
+        }
+
+        static void readBytes(BinaryReader& stream,char* p,size_t n)
+        {
+            stream.read((unsigned char*)p,n);
+        }
+
+        //跳过超过长度限制的内容，保证后面的节点仍然能正确解码
+        static void skipBytes(istream& stream,size_t n)
+        {
+            stream.ignore(n);
+        }
+
+        static void skipBytes(BinaryReader& stream,size_t n)
+        {
+            unsigned char tmp[256];
+            while (n > 0)
+            {
+                size_t step = n < sizeof(tmp) ? n : sizeof(tmp);
+                stream.read(tmp,step);
+                n -= step;
+            }
+        }
+
+        //读取数组的元素个数和内容，总长度超过maxBuffer时得到空数组
+        template<typename S>
+            void loadArray(S& stream,unsigned char flags,unsigned int maxBuffer)
+            {
+                unsigned int count = readLength(stream,flags);
+                uint64_t bytes = (uint64_t)count * elemSize(type);
+                if (bytes > maxBuffer)
+                {
+                    ERROR_LOG("array len > MAX_BUFF(%u),count is [%u]",maxBuffer,count);
+                    skipBytes(stream,bytes);
+                    storeArray(NULL,0);
+                    return;
+                }
+                storeArray(NULL,count);
+                if (bytes > 0)
+                    readBytes(stream,(char*)as<ArrayValue>().p,bytes);
+            }
+
+        //按序号从名称表取得名称
+        template<typename S>
+            void loadName(S& stream,const NameTable& names)
+            {
+                uint64_t id = readVarint(stream);
+                if (id >= names.names.size())
+                {
+                    ERROR_LOG("treecode name index[%u] out of range[%u]",(unsigned int)id,(unsigned int)names.names.size());
+                    name.clear();
+                    return;
+                }
+                const string& s = names.names[id];
+                name.assign(s.data(),s.size());
+            }
+
+        /*读取节点自身（名称、类型、内容），返回子节点数量
+          buffer和数组内容超过maxBuffer字节时得到空的内容
+          */
+        unsigned short loadSelf(istream& stream,unsigned char flags,const NameTable& names,unsigned int maxBuffer = MAX_BUFF_LEN)
+        {		
+            if (flags & TC_FLAG_SUBTREE_SIZE)
+                stream.read((char*)&treeSize,sizeof(treeSize));
+
+            if (flags & TC_FLAG_NAME_TABLE)
+            {
+                loadName(stream,names);
+            }
+            else
+            {
+                byte nameLen=0;
+                stream.read((char*)&nameLen,sizeof(nameLen));			
+
+                char* p=new char[nameLen+1];				
+                stream.read((char*)p,nameLen);			
+                p[nameLen]=0;
+                name.assign(p,nameLen);
+                delete[] p;			
+                p= NULL;
+            }
+
+            byte tmpByte;
+            stream.read((char*)&tmpByte,sizeof(tmpByte));			
+            type=isKnownType(tmpByte) ? (TypeCode)tmpByte : Empty;
+
+            if ((flags & TC_FLAG_VARINT) && isVarintType(type))
+            {
+                fromVarint(type,readVarint(stream),&value);
+                return readSonNum(stream,flags);
+            }
+
+            //根据类型采取不同读取方式
+#define ISTREAM_READ_TYPE(T) {T tmp;stream.read((char*)&tmp,sizeof(tmp));store(tmp);}
+            switch(type)
+            {				
+                case Empty:     break;
+                case Boolean:				ISTREAM_READ_TYPE(bool);				break;
+                case WChar:				ISTREAM_READ_TYPE(unsigned short);				break;
+                case Byte:				ISTREAM_READ_TYPE(unsigned char);				break;
+                case SByte:				ISTREAM_READ_TYPE(unsigned char);				break;
+                case Int16:				ISTREAM_READ_TYPE(short);				break;
+                case UInt16:				ISTREAM_READ_TYPE(unsigned short);				break;
+                case Int32:				ISTREAM_READ_TYPE(int);				break;
+                case UInt32:				ISTREAM_READ_TYPE(unsigned int);				break;
+                case Int64:				ISTREAM_READ_TYPE(int64_t);				break;
+                case UInt64:				ISTREAM_READ_TYPE(uint64_t);				break;
+                case Single:				ISTREAM_READ_TYPE(float);				break;
+                case Double:				ISTREAM_READ_TYPE(double);				break;
+                case UTF8String:
+                                                {
+                                                unsigned int len = readLength(stream,flags);
+                                                NodeString* s = new(&value) NodeString(ArenaAllocator<char>(arena));
+                                                s->resize(len);
+                                                if (len > 0)
+                                                    stream.read(&(*s)[0],len);
+                                                }
+                                                break;
+                case Buffer:
+                                                {
+                                                unsigned int len = readLength(stream,flags);
+                                                if (len > maxBuffer)
+                                                {
+                                                    ERROR_LOG("buffer len > MAX_BUFF(%u),len is [%u]",maxBuffer,len);
+                                                    skipBytes(stream,len);
+                                                    storeBuffer(NULL,0);
+                                                    break;
+                                                }
+                                                storeBuffer(NULL,len);
+                                                if (len > 0)
+                                                    stream.read((char*)as<buffer_t>().p,len);
+                                                }
+                                                break;
+                case Vector2:				ISTREAM_READ_TYPE(float2);				break;
+                case Vector3:				ISTREAM_READ_TYPE(float3);				break;
+                case Pos2:                  ISTREAM_READ_TYPE(pos2);   break;
+                case Int32Array:
+                case Int64Array:
+                case SingleArray:
+                case DoubleArray:
+                case Vector2Array:
+                case Vector3Array:
+                case Pos2Array:             loadArray(stream,flags,maxBuffer);    break;
+                default:	
 #ifdef DEBUG_PRINT
-                                        printf("not expected typecode:%d\n",type);
+                                            printf("not expected typecode:%d\n",type);
 #endif
-                                        assert(!"not expected typecode");
-                                        break;
-        }								
+                                            assert(!"not expected typecode");
+                                            break;
+            }		
 
-        unsigned short sonNum=(unsigned short)sons.size();
-        stream.write((char*)&sonNum,sizeof(sonNum));
+            unsigned short num = readSonNum(stream,flags);
+            //printf("node[%s] have sons[%u]\n",name.c_str(),num);
+            return num;
+        }
 
-        for (unsigned int i=0;i<sons.size();i++)
+        /*非递归解码整棵树，stack可重复使用
+          深度超过maxDepth时停止解码并返回false；超过maxBuffer字节的buffer和数组得到空的内容
+          */
+        template<typename S>
+            bool load(S& stream,unsigned char flags,WorkStack& stack,unsigned int maxDepth,unsigned int maxBuffer = MAX_BUFF_LEN)
+            {
+                stack.clear();
+                NameTable names;
+                if ((flags & TC_FLAG_NAME_TABLE) && !readNameTable(stream,names))
+                    return false;
+                unsigned short num = loadSelf(stream,flags,names,maxBuffer);
+                if (num > 0)
+                {
+                    sons.reserve(num);
+                    stack.push_back(Frame(this,num));
+                }
+                while (!stack.empty())
+                {
+                    Frame& f = stack.back();
+                    if (f.next == 0)
+                    {
+                        stack.pop_back();
+                        continue;
+                    }
+                    f.next--;
+                    Node* n = create(f.node->arena);
+                    f.node->sons.push_back(n);
+                    n->parent = f.node;
+                    num = n->loadSelf(stream,flags,names,maxBuffer);
+                    if (num > 0)
+                    {
+                        if (stack.size() >= maxDepth)
+                        {
+                            ERROR_LOG("treecode too deep, max depth[%u]",maxDepth);
+                            return false;
+                        }
+                        n->sons.reserve(num);
+                        stack.push_back(Frame(n,num));
+                    }
+                }
+                return true;
+            }
+
+        bool load(istream& stream)
+        {
+            WorkStack stack;
+            return load(stream,0,stack,TREECODE_MAX_DEPTH);
+        }
+
+        bool load(BinaryReader& stream,unsigned char flags = 0)
+        {
+            WorkStack stack;
+            return load(stream,flags,stack,TREECODE_MAX_DEPTH);
+        }
+
+        //自动识别格式：有消息头时按头里的flags解码，否则按v1解码；压缩的消息需要先解压
+        bool load(void* data,unsigned int len,WorkStack& stack,unsigned int maxDepth,unsigned int maxBuffer = MAX_BUFF_LEN)
+        {
+            unsigned char flags = 0;
+            if (readTreeCodeHeader(data,len,flags))
+            {
+                if ((flags & ~TC_FLAG_MASK) || (flags & TC_FLAG_COMPRESSED))
+                {
+                    ERROR_LOG("unsupported treecode flags[%u]",flags);
+                    return false;
+                }
+                BinaryReader stream((char*)data + TREECODE_HEADER_SIZE,len - TREECODE_HEADER_SIZE,false);
+                return load(stream,flags,stack,maxDepth,maxBuffer);
+            }
+            BinaryReader stream(data,len,false);
+            return load(stream,0,stack,maxDepth,maxBuffer);
+        }
+
+        bool load(void* data,unsigned int len)
+        {
+            WorkStack stack;
+            return load(data,len,stack,TREECODE_MAX_DEPTH);
+        }
+
+        /*只检查消息结构、不解码：边界、类型码、名称序号、子树长度和深度，规则与load相同，
+          通过后按同样的maxDepth和maxBuffer解码不会读到数据之外；除了可以重复使用的buff，不分配内存
+          result给出节点数和各种内容的总长度，解码前可以据此一次预留arena
+          */
+        static bool scan(const void* data,unsigned int len,ScanBuffer& buff,unsigned int maxDepth,unsigned int maxBuffer,ScanResult& result)
+        {
+            result.clear();
+            WireReader r(data,len);
+            unsigned char flags = 0;
+            if (readTreeCodeHeader(data,len,flags))
+            {
+                if ((flags & ~TC_FLAG_MASK) || (flags & TC_FLAG_COMPRESSED))
+                {
+                    ERROR_LOG("unsupported treecode flags[%u]",flags);
+                    return false;
+                }
+                r.skip(TREECODE_HEADER_SIZE);
+            }
+            if ((flags & TC_FLAG_NAME_TABLE) && !scanNameTable(r,buff.nameLens))
+                return scanFailed(r);
+
+            if (!scanTree(r,flags,buff,maxDepth,maxBuffer,result))
+                return scanFailed(r);
+            result.used = r.offset();
+            return true;
+        }
+
+        /*检查r当前位置的一棵子树，结果累加到result，成功后r停在子树之后
+          maxDepth的含义与load相同；并行解码时每个线程用它检查自己的任务
+          */
+        static bool scanTree(WireReader& r,unsigned char flags,ScanBuffer& buff,unsigned int maxDepth,unsigned int maxBuffer,ScanResult& result)
+        {
+            vector<ScanFrame>& stack = buff.stack;
+            stack.clear();
+            unsigned short num = 0;
+            const unsigned char* end = NULL;
+            if (!scanSelf(r,flags,buff,maxBuffer,result,num,end) || !scanEnter(r,stack,maxDepth,result,num,end))
+                return false;
+            while (!stack.empty())
+            {
+                ScanFrame& f = stack.back();
+                if (f.left == 0)
+                {
+                    if (f.end != NULL && r.pos() != f.end)
+                        return false;
+                    stack.pop_back();
+                    continue;
+                }
+                f.left--;
+                if (!scanSelf(r,flags,buff,maxBuffer,result,num,end) || !scanEnter(r,stack,maxDepth,result,num,end))
+                    return false;
+            }
+            return true;
+        }
+
+        /*在arena中构造一个NodeString并resize或assign到n字节时从arena申请的字节数，用于估算arena的用量
+          短字符串放在对象内部的实现：n不超过内部容量时为0，超过时容量至少翻倍；
+          引用计数的实现：分配器与默认的不相等，构造空串时就要申请一次，内容前面有长度、容量和计数
+          */
+        static size_t stringAlloc(size_t n)
         {
-            sons[i]->save(stream);
+            static const size_t local = NodeString(ArenaAllocator<char>(NULL)).capacity();
+            if (local == 0)
+            {
+                const size_t rep = 3 * sizeof(size_t);
+                return arenaSize(1 + rep) + (n > 0 ? arenaSize(n + 1 + rep) : 0);
+            }
+            if (n <= local)
+                return 0;
+            return arenaSize((n < 2 * local ? 2 * local : n) + 1);
+        }
+
+        static size_t arenaSize(size_t n)
+        {
+            return (n + TreeArena::ALIGN - 1) & ~(size_t)(TreeArena::ALIGN - 1);
+        }
+
+        static bool scanFailed(const WireReader& r)
+        {
+            ERROR_LOG("treecode scan failed, offset[%u]",(unsigned int)r.offset());
+            return false;
+        }
+
+        static bool scanNameTable(WireReader& r,vector<unsigned char>& lens)
+        {
+            lens.clear();
+            uint64_t count = 0;
+            if (!r.readVarint(count) || count > TREECODE_MAX_NAMES || count > r.left())
+                return false;
+            lens.resize(count);
+            for (size_t i=0;i<count;i++)
+            {
+                if (!r.read(lens[i]) || !r.skip(lens[i]))
+                    return false;
+            }
+            return true;
+        }
+
+        static bool scanLength(WireReader& r,bool varint,uint64_t& len)
+        {
+            if (!varint)
+            {
+                unsigned int n = 0;
+                if (!r.read(n))
+                    return false;
+                len = n;
+                return true;
+            }
+            return r.readVarint(len) && len <= 0xFFFFFFFFu;
+        }
+
+        //检查一个节点自身，num是子节点数量，end是带子树长度时子树的结束位置
+        static bool scanSelf(WireReader& r,unsigned char flags,const ScanBuffer& buff,unsigned int maxBuffer,ScanResult& result,unsigned short& num,const unsigned char*& end)
+        {
+            end = NULL;
+            if (flags & TC_FLAG_SUBTREE_SIZE)
+            {
+                unsigned int treeSize = 0;
+                if (!r.read(treeSize) || r.left() < treeSize)
+                    return false;
+                end = r.pos() + treeSize;
+            }
+
+            size_t nameLen = 0;
+            if (flags & TC_FLAG_NAME_TABLE)
+            {
+                uint64_t id = 0;
+                if (!r.readVarint(id) || id >= buff.nameLens.size())
+                    return false;
+                nameLen = buff.nameLens[id];
+            }
+            else
+            {
+                unsigned char n = 0;
+                if (!r.read(n) || !r.skip(n))
+                    return false;
+                nameLen = n;
+            }
+            unsigned char intType = 0;
+            if (!r.read(intType) || !isKnownType(intType))
+                return false;
+            TypeCode type = (TypeCode)intType;
+            result.nodes++;
+            result.nameBytes += nameLen;
+            result.arenaBytes += arenaSize(sizeof(Node)) + stringAlloc(nameLen);
+
+            bool varint = (flags & TC_FLAG_VARINT) != 0;
+            int size = valueSize(type);
+            uint64_t v = 0;
+            if (varint && isVarintType(type))
+            {
+                if (!r.readVarint(v))
+                    return false;
+            }
+            else if (size < 0)
+            {
+                if (!scanLength(r,varint,v))
+                    return false;
+                uint64_t bytes = isArrayType(type) ? v * elemSize(type) : v;
+                if (bytes > r.left())
+                    return false;
+                r.skip(bytes);
+                if (type == UTF8String)
+                {
+                    result.stringBytes += bytes;
+                    result.arenaBytes += stringAlloc(bytes);
+                }
+                else if (bytes <= maxBuffer && bytes > 0)
+                {
+                    //与loadSelf相同：数组都在arena中，小的buffer在arena中，大的在TreeBlock中
+                    result.valueBytes += bytes;
+                    if (isArrayType(type) || bytes < TREECODE_BLOCK_MIN)
+                        result.arenaBytes += arenaSize(bytes);
+                }
+            }
+            else if (!r.skip(size))
+            {
+                return false;
+            }
+
+            if (varint)
+            {
+                if (!r.readVarint(v) || v > 0xFFFF)
+                    return false;
+                num = (unsigned short)v;
+            }
+            else if (!r.read(num))
+            {
+                return false;
+            }
+            if (num > 0)
+                result.arenaBytes += arenaSize(num * sizeof(Node*));
+            return true;
+        }
+
+        //节点自身检查完：没有子节点时核对子树长度，否则入栈
+        static bool scanEnter(const WireReader& r,vector<ScanFrame>& stack,unsigned int maxDepth,ScanResult& result,unsigned short num,const unsigned char* end)
+        {
+            if (num == 0)
+                return end == NULL || r.pos() == end;
+            if (stack.size() >= maxDepth)
+            {
+                ERROR_LOG("treecode too deep, max depth[%u]",maxDepth);
+                return false;
+            }
+            stack.push_back(ScanFrame(num,end));
+            if (stack.size() > result.depth)
+                result.depth = stack.size();
+            return true;
+        }
+
+        //读取节点自身（名称、类型、内容），返回子节点数量
+        unsigned short loadSelf(BinaryReader& stream,unsigned char flags,const NameTable& names,unsigned int maxBuffer = MAX_BUFF_LEN)
+        {
+            if (flags & TC_FLAG_SUBTREE_SIZE)
+                stream >> treeSize;
+
+            UInt8 nameLen = 0;
+            UInt8 intType = 0;
+            if (flags & TC_FLAG_NAME_TABLE)
+            {
+                loadName(stream,names);
+            }
+            else
+            {
+                stream >> nameLen;
+                name.resize(nameLen);
+                if (nameLen > 0)
+                    stream.read((unsigned char*)&name[0],nameLen);
+            }
+            //printf("###1:pos:%u\n",stream.pos());
+            stream >> intType;
+            //未经检查的消息中编码器写不出的类型按Empty处理，不转成无效的枚举值
+            type = isKnownType(intType) ? (TypeCode) intType : Empty;
+            //printf("###2:pos:%u\n",stream.pos());
+
+            if ((flags & TC_FLAG_VARINT) && isVarintType(type))
+            {
+                fromVarint(type,readVarint(stream),&value);
+                return readSonNum(stream,flags);
+            }
+
+#define READ_TYPE(T) {T tmp; memset(&tmp,0,sizeof(tmp)); stream >> tmp; store(tmp);}
+
+            switch(type)
+            {				
+                case Empty:            
+             //       printf("empty---------\n");
+                    break;
+                case Boolean:		   READ_TYPE(bool);				break;
+                case WChar:			   READ_TYPE(unsigned short);				break;
+                case Byte:			   READ_TYPE(unsigned char);				break;
+                case SByte:			   READ_TYPE(unsigned char);				break;
+                case Int16:			   READ_TYPE(short);				break;
+                case UInt16:		   READ_TYPE(unsigned short);				break;
+                case Int32:			   READ_TYPE(int);				break;
+                case UInt32:		   READ_TYPE(unsigned int);				break;
+                case Int64:			   READ_TYPE(int64_t);				break;
+                case UInt64:		   READ_TYPE(uint64_t);				break;
+                case Single:		   READ_TYPE(float);				break;
+                case Double:		   READ_TYPE(double);				break;
+                case UTF8String:	   
+                                       {
+                                           unsigned int len = readLength(stream,flags);
+                                           NodeString* s = new(&value) NodeString(ArenaAllocator<char>(arena));
+                                           s->resize(len);
+                                           if (len > 0)
+                                               stream.read((unsigned char*)&(*s)[0],len);
+                                       }
+                                       break;				
+                case Buffer:           
+                                       {
+                                           unsigned int len = readLength(stream,flags);
+                                           if(len > maxBuffer or len < 1)
+                                           {
+                                               ERROR_LOG("buffer len > MAX_BUFF(%u) or buffer is null,len is [%u]",maxBuffer,len);
+                                               DEBUG_LOG("buffer len > MAX_BUFF(%u) or buffer is null,len is [%u]",maxBuffer,len);
+                                               skipBytes(stream,len);
+                                               storeBuffer(NULL,0);
+                                               break;
+                                           }
+                                           storeBuffer(NULL,len);
+                                           stream.read((unsigned char*)as<buffer_t>().p,len);
+                                           //DEBUG_LOG("tree read buffer,buff_len[%u]",tmp.len);
+                                       }
+                                       break;
+                case Vector2:		   READ_TYPE(float2);				break;
+                case Vector3:		   READ_TYPE(float3);				break;
+                case Pos2:		       READ_TYPE(pos2);				break;
+                case Int32Array:
+                case Int64Array:
+                case SingleArray:
+                case DoubleArray:
+                case Vector2Array:
+                case Vector3Array:
+                case Pos2Array:        loadArray(stream,flags,maxBuffer);        break;
+                default:	
+#ifdef DEBUG_PRINT
+                                       DEBUG_LOG("not expected typecode:%d",type);
+#endif
+                                       //assert(!"not expected typecode");
+                                       break;
+            }
+            unsigned short num = readSonNum(stream,flags);
+            //num = ntohs(num);
+            //printf("pos[%u],node[%s]---sons num:[%u]\n",stream.pos(),name.c_str(),num);
+            return num;
+        }
+
+    /*非递归保存到ostream或Stream，stack可重复使用
+      flags带TC_FLAG_SUBTREE_SIZE时每个节点前先写4字节子树长度，需要先调用computeSize
+      */
+    template<typename S>
+    void save(S& stream,unsigned char flags,WorkStack& stack)
+    {
+        stack.clear();
+        saveSelf(stream,flags);
+        if (!sons.empty())
+            stack.push_back(Frame(this,0));
+        while (!stack.empty())
+        {
+            Frame& f = stack.back();
+            if (f.next == f.node->sons.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            Node* n = f.node->sons[f.next++];
+            n->saveSelf(stream,flags);
+            if (!n->sons.empty())
+                stack.push_back(Frame(n,0));
         }
     }
 
+    template<typename S>
+    void save(S& stream,unsigned char flags = 0)
+    {
+        WorkStack stack;
+        save(stream,flags,stack);
+    }
 
-    void save(Stream& stream)
+    //写入节点自身（名称、类型、内容、子节点数量）
+    template<typename S>
+    void saveSelf(S& stream,unsigned char flags)
     {
+        if (flags & TC_FLAG_SUBTREE_SIZE)
+            stream.write((char*)&treeSize,sizeof(treeSize));
+
         assert(((name.size() < 65536) || !"node's name is too long to save name"));
 
-        byte tmp=name.size();
-        stream.write((char*)&tmp,sizeof(tmp));			
-        stream.write((char*)name.c_str(),name.size());
+        if (flags & TC_FLAG_NAME_TABLE)
+        {
+            writeVarint(stream,nameIndex);
+        }
+        else
+        {
+            byte tmp=name.size();
+            stream.write((char*)&tmp,sizeof(tmp));			
+            stream.write((char*)name.c_str(),name.size());
+        }
 
         byte tmpByte=type;
         stream.write((char*)&tmpByte,sizeof(tmpByte));
 
+        if ((flags & TC_FLAG_VARINT) && isVarintType(type))
+        {
+            writeVarint(stream,toVarint(type,&value));
+            writeSonNum(stream,flags);
+            return;
+        }
+
         //根据类型采取不同写入方式
         buffer_t buff;
-#define WRITE_TYPE(T) {T tmp=boost::any_cast<T>(obj);stream.write((char*)&tmp,sizeof(tmp));}
+#define WRITE_TYPE(T) {const T& tmp=as<T>();stream.write((char*)&tmp,sizeof(tmp));}
         switch(type)
         {				
             case Empty:              break; //write nothing
@@ -470,16 +1540,38 @@ class Node
             case UInt64:				WRITE_TYPE(uint64_t);				break;
             case Single:				WRITE_TYPE(float);				break;
             case Double:				WRITE_TYPE(double);				break;
-            case UTF8String:				writeString(stream,boost::any_cast<string>(obj));						break;				
+            case UTF8String:
+                                            {
+                                            const NodeString& str=as<NodeString>();
+                                            writeLength(stream,str.size(),flags);
+                                            stream.write((char*)str.data(),str.size());
+                                            }
+                                            break;
             case Buffer:
-                                            buff=boost::any_cast<buffer_t>(obj);				
-                                            stream.write((char*)&buff.len,sizeof(buff.len));										
+                                            {
+                                            buff=as<buffer_t>();
+                                            writeLength(stream,buff.len,flags);
                                             if(buff.len > 0 && buff.p != NULL)
                                                 stream.write((char*)buff.p,buff.len);
+                                            }
                                             break;
             case Vector2:				WRITE_TYPE(float2);				break;
             case Vector3:				WRITE_TYPE(float3);				break;
             case Pos2:				WRITE_TYPE(pos2);				break;
+            case Int32Array:
+            case Int64Array:
+            case SingleArray:
+            case DoubleArray:
+            case Vector2Array:
+            case Vector3Array:
+            case Pos2Array:
+                                            {
+                                            const ArrayValue& a=as<ArrayValue>();
+                                            writeLength(stream,a.count,flags);
+                                            if(a.count > 0)
+                                                stream.write((char*)a.p,(size_t)a.count * elemSize(type));
+                                            }
+                                            break;
             default:	
 #ifdef DEBUG_PRINT
                                         printf("not expected typecode:%d\n",type);
@@ -488,119 +1580,578 @@ class Node
                                         break;
         }								
 
+        writeSonNum(stream,flags);
+    }
+
+    template<typename S>
+    static void writeLength(S& stream,unsigned int len,unsigned char flags)
+    {
+        if (flags & TC_FLAG_VARINT)
+            writeVarint(stream,len);
+        else
+            stream.write((char*)&len,sizeof(len));
+    }
+
+    template<typename S>
+    void writeSonNum(S& stream,unsigned char flags)
+    {
         unsigned short sonNum=(unsigned short)sons.size();
-        stream.write((char*)&sonNum,sizeof(sonNum));
+        if (flags & TC_FLAG_VARINT)
+            writeVarint(stream,sonNum);
+        else
+            stream.write((char*)&sonNum,sizeof(sonNum));
+    }
 
-        for (unsigned int i=0;i<sons.size();i++)
+    static unsigned int lengthSize(unsigned int len,unsigned char flags)
+    {
+        return (flags & TC_FLAG_VARINT) ? varintSize(len) : sizeof(unsigned int);
+    }
+
+    //内容部分的编码长度
+    unsigned int valueEncodedSize(unsigned char flags) const
+    {
+        if ((flags & TC_FLAG_VARINT) && isVarintType(type))
+            return varintSize(toVarint(type,&value));
+        int size = valueSize(type);
+        if (size >= 0)
+            return size;
+        if (type == UTF8String)
+            return lengthSize(as<NodeString>().size(),flags) + as<NodeString>().size();
+        if (isArrayType(type))
+            return lengthSize(as<ArrayValue>().count,flags) + as<ArrayValue>().count * elemSize(type);
+        const buffer_t& buff = as<buffer_t>();
+        return lengthSize(buff.len,flags) + ((buff.len > 0 && buff.p != NULL) ? buff.len : 0);
+    }
+
+    //节点自身的编码长度，不含子节点和长度字段
+    unsigned int selfSize(unsigned char flags) const
+    {
+        unsigned int sonNumSize = (flags & TC_FLAG_VARINT) ? varintSize(sons.size()) : sizeof(unsigned short);
+        unsigned int nameSize = (flags & TC_FLAG_NAME_TABLE) ? varintSize(nameIndex) : 1 + name.size();
+        return nameSize + 1 + valueEncodedSize(flags) + sonNumSize;
+    }
+
+    /*非递归收集子树中不同的名称并给每个节点记录序号，返回名称表的编码长度
+      名称表引用节点自己的name，编码完成前不能修改树
+      */
+    unsigned int buildNameTable(NameTable& table,WorkStack& stack)
+    {
+        table.clear();
+        unsigned int size = addName(table);
+        stack.clear();
+        stack.push_back(Frame(this,0));
+        while (!stack.empty())
         {
-            sons[i]->save(stream);
+            Frame& f = stack.back();
+            if (f.next == f.node->sons.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            Node* n = f.node->sons[f.next++];
+            size += n->addName(table);
+            if (!n->sons.empty())
+                stack.push_back(Frame(n,0));
         }
+        return varintSize(table.order.size()) + size;
+    }
+
+    //加入名称表，返回新增的编码长度
+    unsigned int addName(NameTable& table)
+    {
+        pair<NameTable::IdMap::iterator,bool> r = table.ids.insert(make_pair(TreeSlice(name.data(),name.size()),(unsigned int)table.order.size()));
+        nameIndex = r.first->second;
+        if (!r.second)
+            return 0;
+        table.order.push_back(r.first->first);
+        return 1 + name.size();
+    }
+
+    template<typename S>
+    static void writeNameTable(S& stream,const NameTable& table)
+    {
+        writeVarint(stream,table.order.size());
+        for (unsigned int i=0;i<table.order.size();i++)
+        {
+            const TreeSlice& s = table.order[i];
+            byte len = s.size();
+            stream.write((char*)&len,sizeof(len));
+            stream.write(s.c_str(),s.size());
+        }
+    }
+
+    /*非递归计算每棵子树的编码长度并记录到treeSize（不含长度字段本身），
+      返回包括长度字段的总长度
+      */
+    unsigned int computeSize(unsigned char flags,WorkStack& stack)
+    {
+        unsigned int prefix = (flags & TC_FLAG_SUBTREE_SIZE) ? sizeof(treeSize) : 0;
+        stack.clear();
+        treeSize = selfSize(flags);
+        stack.push_back(Frame(this,0));
+        while (!stack.empty())
+        {
+            Frame& f = stack.back();
+            if (f.next < f.node->sons.size())
+            {
+                Node* n = f.node->sons[f.next++];
+                n->treeSize = n->selfSize(flags);
+                stack.push_back(Frame(n,0));
+                continue;
+            }
+            Node* done = f.node;
+            stack.pop_back();
+            if (!stack.empty())
+                stack.back().node->treeSize += done->treeSize + prefix;
+        }
+        return treeSize + prefix;
+    }
+
+    unsigned int computeSize(unsigned char flags)
+    {
+        WorkStack stack;
+        return computeSize(flags,stack);
     }
 
 
 
     string printAny()
     {
-        int len;float2 v2;float3 v3; pos2 pos;
-#define ANY_TOSTRING(T) boost::lexical_cast<string>(boost::any_cast<T>(obj))
+        string s;
+        appendValue(s);
+        return s;
+    }
+
+    //按print的格式把内容追加到out：数字直接转换，浮点数的精度与lexical_cast相同
+    void appendValue(string& out) const
+    {
+        switch(type)
+        {
+            case Empty:         out += "null";                          break;
+            case Boolean:       out += as<bool>() ? "true" : "false";   break;
+            case WChar:         appendNumber(out,as<unsigned short>()); break;
+            case Byte:          appendNumber(out,as<unsigned char>());  break;
+            case SByte:         appendNumber(out,as<signed char>());    break;
+            case Int16:         appendNumber(out,as<short>());          break;
+            case UInt16:        appendNumber(out,as<unsigned short>()); break;
+            case Int32:         appendNumber(out,as<int>());            break;
+            case UInt32:        appendNumber(out,as<unsigned int>());   break;
+            case Int64:         appendNumber(out,as<int64_t>());        break;
+            case UInt64:        appendNumber(out,as<uint64_t>());       break;
+            case Single:        appendNumber(out,as<float>());          break;
+            case Double:        appendNumber(out,as<double>());         break;
+            case UTF8String:    out.append(as<NodeString>().data(),as<NodeString>().size()); break;
+            case Buffer:
+                out += "buffer[";
+                appendNumber(out,as<buffer_t>().len);
+                out += ']';
+                break;
+            case Vector2:
+                out += "vector2";
+                appendVector(out,as<float2>());
+                break;
+            case Vector3:
+                out += "vector3";
+                appendVector(out,as<float3>());
+                break;
+            case Pos2:
+                out += "pos2";
+                appendVector(out,as<pos2>());
+                break;
+            default:
+                if (isArrayType(type))
+                {
+                    out += "array[";
+                    appendNumber(out,as<ArrayValue>().count);
+                    out += ']';
+                }
+                break;
+        }
+    }
+
+    /*按JSON格式把内容追加到out：Empty及没有内容的类型为null，数字不加引号（NaN和无穷为null），
+      向量和数组为数字数组，buffer为内容的十六进制字符串
+      */
+    void appendJson(string& out) const
+    {
         switch(type)
         {
-            case Empty:
-                return ANY_TOSTRING(string);
+            case UTF8String:
+                appendJsonString(out,as<NodeString>().data(),as<NodeString>().size());
+                break;
+            case Single:
+                appendJsonNumber(out,as<float>());
+                break;
+            case Double:
+                appendJsonNumber(out,as<double>());
+                break;
+            case Buffer:
+                {
+                    static const char hex[] = "0123456789abcdef";
+                    const buffer_t& buff = as<buffer_t>();
+                    const byte* p = (const byte*)buff.p;
+                    out += '"';
+                    for (unsigned int i=0;p != NULL && i<buff.len;i++)
+                    {
+                        out += hex[p[i] >> 4];
+                        out += hex[p[i] & 15];
+                    }
+                    out += '"';
+                }
+                break;
+            case Vector2:   appendVector(out,as<float2>(),true);   break;
+            case Vector3:   appendVector(out,as<float3>(),true);   break;
+            case Pos2:      appendVector(out,as<pos2>(),true);     break;
+            case Int32Array:    appendJsonArray<int>(out);      break;
+            case Int64Array:    appendJsonArray<int64_t>(out);  break;
+            case SingleArray:   appendJsonArray<float>(out);    break;
+            case DoubleArray:   appendJsonArray<double>(out);   break;
+            case Vector2Array:  appendJsonArray<float2>(out);   break;
+            case Vector3Array:  appendJsonArray<float3>(out);   break;
+            case Pos2Array:     appendJsonArray<pos2>(out);     break;
             case Boolean:
-                return boost::any_cast<bool>(obj) ? "true":"false";
             case WChar:
-                return ANY_TOSTRING(unsigned short);
             case Byte:
-                {
-                    unsigned short t = boost::any_cast<unsigned char>(obj);
-                    return boost::lexical_cast<string>(t);
-                }
+            case SByte:
             case Int16:
-                return ANY_TOSTRING(short);
             case UInt16:
-                return ANY_TOSTRING(unsigned short);
             case Int32:
-                return ANY_TOSTRING(int);
             case UInt32:
-                return ANY_TOSTRING(unsigned int);
             case Int64:
-                return ANY_TOSTRING(int64_t);
             case UInt64:
-                return ANY_TOSTRING(uint64_t);
-            case Single:
-                return ANY_TOSTRING(float);
-            case Double:
-                return ANY_TOSTRING(double);
-            case UTF8String:
-                return ANY_TOSTRING(string);
-            case Buffer:
-                len=boost::any_cast<buffer_t>(obj).len;
-                return string("buffer[")+boost::lexical_cast<string>(len)+"]";
-                break;
-            case Vector2:
-                v2=boost::any_cast<float2>(obj);
-                return string("vector2[")+boost::lexical_cast<string>(v2.x)+","+boost::lexical_cast<string>(v2.y)+"]";
-                break;
-            case Vector3:
-                v3=boost::any_cast<float3>(obj);
-                return string("vector3[")+boost::lexical_cast<string>(v3.x)+","+boost::lexical_cast<string>(v3.y)+","+boost::lexical_cast<string>(v3.z)+"]";
-                break;
-            case Pos2:
-                pos=boost::any_cast<pos2>(obj);
-                return string("pos2[")+boost::lexical_cast<string>(pos.x)+","+boost::lexical_cast<string>(pos.y)+"]";
+                appendValue(out);
                 break;
-                
             default:
-                /*do nothing */
+                //Empty以及没有可输出内容的类型
+                out += "null";
                 break;
-        };
-        return string(""); //return null string
+        }
+    }
+
+    //整数逐位转换，不经过流
+    static void appendUInt(string& out,uint64_t v)
+    {
+        char buf[20];
+        char* p = buf + sizeof(buf);
+        do
+        {
+            *--p = (char)('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        out.append(p,buf + sizeof(buf) - p);
+    }
+
+    static void appendInt(string& out,int64_t v)
+    {
+        if (v < 0)
+        {
+            out += '-';
+            appendUInt(out,0 - (uint64_t)v);
+        }
+        else
+            appendUInt(out,v);
+    }
+
+    //浮点数的有效位数与lexical_cast相同，保证能够还原
+    template<typename T>
+        static void appendNumber(string& out,T v)
+        {
+            if (std::numeric_limits<T>::is_integer)
+            {
+                if (std::numeric_limits<T>::is_signed)
+                    appendInt(out,(int64_t)v);
+                else
+                    appendUInt(out,(uint64_t)v);
+                return;
+            }
+            //整数值的浮点数直接按整数输出，与%g的结果相同（-0和很大的数除外）
+            if (v != 0 && v > -1e9 && v < 1e9 && v == (T)(int64_t)v)
+            {
+                appendInt(out,(int64_t)v);
+                return;
+            }
+            char buf[32];
+            int precision = 2 + std::numeric_limits<T>::digits * 30103UL / 100000UL;
+            int n = snprintf(buf,sizeof(buf),"%.*g",precision,(double)v);
+            out.append(buf,n);
+        }
+
+    template<typename T>
+        static void appendJsonNumber(string& out,T v)
+        {
+            if (v != v || v - v != 0)//NaN或无穷
+                out += "null";
+            else
+                appendNumber(out,v);
+        }
+
+    static void appendJsonNumber(string& out,const float2& v) { appendVector(out,v,true); }
+    static void appendJsonNumber(string& out,const float3& v) { appendVector(out,v,true); }
+    static void appendJsonNumber(string& out,const pos2& v) { appendVector(out,v,true); }
+
+    //json为false时是print格式"[x,y]"，否则是JSON数组
+    static void appendVector(string& out,const float2& v,bool json = false)
+    {
+        out += '[';
+        appendComponent(out,v.x,json);
+        out += ',';
+        appendComponent(out,v.y,json);
+        out += ']';
+    }
+
+    static void appendVector(string& out,const float3& v,bool json = false)
+    {
+        out += '[';
+        appendComponent(out,v.x,json);
+        out += ',';
+        appendComponent(out,v.y,json);
+        out += ',';
+        appendComponent(out,v.z,json);
+        out += ']';
+    }
+
+    static void appendVector(string& out,const pos2& v,bool json = false)
+    {
+        out += '[';
+        appendComponent(out,v.x,json);
+        out += ',';
+        appendComponent(out,v.y,json);
+        out += ']';
+    }
+
+    template<typename T>
+        static void appendComponent(string& out,T v,bool json)
+        {
+            if (json)
+                appendJsonNumber(out,v);
+            else
+                appendNumber(out,v);
+        }
+
+    template<typename T>
+        void appendJsonArray(string& out) const
+        {
+            const ArrayValue& a = as<ArrayValue>();
+            const T* p = (const T*)a.p;
+            out += '[';
+            for (unsigned int i=0;i<a.count;i++)
+            {
+                if (i > 0)
+                    out += ',';
+                appendJsonNumber(out,p[i]);
+            }
+            out += ']';
+        }
+
+    //带引号的JSON字符串，控制字符转义，其余字节原样输出
+    static void appendJsonString(string& out,const char* p,size_t n)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        size_t begin = 0;
+        for (size_t i=0;i<n;i++)
+        {
+            unsigned char c = p[i];
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+            out.append(p + begin,i - begin);
+            begin = i + 1;
+            switch (c)
+            {
+                case '"':   out += "\\\"";   break;
+                case '\\':  out += "\\\\";  break;
+                case '\n':  out += "\\n";    break;
+                case '\r':  out += "\\r";    break;
+                case '\t':  out += "\\t";    break;
+                default:
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 15];
+                    break;
+            }
+        }
+        out.append(p + begin,n - begin);
+        out += '"';
     }
 
     private:
+    Node(const Node&);
+    Node& operator=(const Node&);
+
 //    public:
-    string name;//节点名称	
+    NodeString name;//节点名称	
     TypeCode type;//类型序号
-    boost::any obj;//内容
-    vector<Node*> sons;//子节点
+    bool dirty;//修改后还没有重新编码，为true时所有祖先也一定为true
+    //内容，按type解释：定长类型原地存放，UTF8String是NodeString（短串不分配），Buffer是buffer_t
+    union
+    {
+        char str[sizeof(NodeString)];
+        char buff[sizeof(BufferValue)];
+        char vec2[sizeof(float2)];
+        char vec3[sizeof(float3)];
+        char pos[sizeof(pos2)];
+        char arr[sizeof(ArrayValue)];
+        int64_t i64;
+        double d;
+        void* ptr;
+    } value;
+    NodeList sons;//子节点
     Node* parent;//父节点
+    TreeArena* arena;//节点所在的arena，NULL表示堆上分配
+    unsigned int treeSize;//子树编码长度，由computeSize计算
+    unsigned int nameIndex;//名称在名称表中的序号，由buildNameTable设置
+    unsigned int cacheOffset;//在编码缓存中相对父节点起始位置的偏移
+    unsigned int cacheLen;//在编码缓存中的长度（包括子树长度字段和所有子节点）
+
+    //名称到第一个同名子节点，key指向子节点自己的name
+    typedef boost::unordered_map<TreeSlice,Node*,SliceHash,SliceEqual> SonIndex;
+
+    void buildIndex()
+    {
+        index = new SonIndex(sons.size());
+        for (unsigned int i=0;i<sons.size();i++)
+        {
+            index->insert(make_pair(TreeSlice(sons[i]->name.data(),sons[i]->name.size()),sons[i]));
+        }
+    }
+
+    SonIndex* index;//子节点索引，子节点多时在第一次按名称查找时建立
 };
 
 
 class TreeCode
 {
+    friend class TreeCodeDecoder;
+    friend class TreeCodeParallelLoader;
+    friend class TreeCodeDiff;
     public:
-        TreeCode():focusNode(NULL),rootNode(NULL)
+        TreeCode():focusNode(NULL),rootNode(NULL),arena(NULL),maxDepth(TREECODE_MAX_DEPTH),maxBufferLen(MAX_BUFF_LEN),validateInput(true),compressThreshold(TREECODE_COMPRESS_MIN),cacheEnabled(false),cacheFlags(-1),cacheCur(0)
         {
 
         }
 
         ~TreeCode()
         {
-            if(rootNode != NULL){
-                delete(rootNode);
-            }
+            reset();
+            delete arena;
+            for (unsigned int i=0;i<workerArenas.size();i++)
+                delete workerArenas[i];
         }
 
-        TreeCode(const string& name):focusNode(NULL),rootNode(NULL)
+        TreeCode(const string& name):focusNode(NULL),rootNode(NULL),arena(NULL),maxDepth(TREECODE_MAX_DEPTH),maxBufferLen(MAX_BUFF_LEN),validateInput(true),compressThreshold(TREECODE_COMPRESS_MIN),cacheEnabled(false),cacheFlags(-1),cacheCur(0)
         {
             addEmptyNode(name);
         }
 
+        /*启用arena，之后的节点、名称和buffer内容都从arena中分配，
+          应在添加节点或load之前调用
+          */
+        void enableArena(size_t blockSize = TreeArena::DEFAULT_BLOCK_SIZE)
+        {
+            if (arena == NULL)
+                arena = new TreeArena(blockSize);
+        }
+
+        //设置解码时允许的最大深度
+        void setMaxDepth(unsigned int depth)
+        {
+            maxDepth = depth;
+        }
+
+        /*设置解码时buffer和数组内容允许的最大字节数，默认MAX_BUFF_LEN
+          超过的内容解码为空，防止异常数据导致大量分配
+          */
+        void setMaxBufferLen(unsigned int len)
+        {
+            maxBufferLen = len;
+        }
+
+        /*解码前是否先用Node::scan完整检查一遍消息，默认开启：
+          不合法或截断的消息在创建任何节点之前被拒绝，启用arena时按检查结果一次预留足够的内存。
+          数据完全可信时可以关闭，省去这一遍扫描
+          */
+        void setValidate(bool enable)
+        {
+            validateInput = enable;
+        }
+
+        //带TC_FLAG_COMPRESSED输出时，编码后小于size字节的消息不压缩
+        void setCompressThreshold(unsigned int size)
+        {
+            compressThreshold = size;
+        }
+
+        /*启用编码缓存：保存整棵树上一次的编码结果，节点修改时标记自己和祖先失效，
+          再次输出时没有修改的子树直接拷贝上次的编码，只重新编码修改过的路径。
+          适合反复输出只改了少数节点的大树；带TC_FLAG_NAME_TABLE时名称序号是全局的，不使用缓存
+          */
+        void enableEncodeCache(bool enable = true)
+        {
+            cacheEnabled = enable;
+            cacheFlags = -1;
+            if (!enable)
+            {
+                for (int i=0;i<2;i++)
+                    vector<char>().swap(encodeCache[i]);
+            }
+        }
+
+        //清空整棵树，启用arena时内存留在arena中供下一条消息复用
+        void reset()
+        {
+            Node::destroy(rootNode,destroyStack);
+            rootNode = focusNode = NULL;
+            cacheFlags = -1;
+            if (arena != NULL)
+                arena->reset();
+            for (unsigned int i=0;i<workerArenas.size();i++)
+                workerArenas[i]->reset();
+        }
+
+        /*整棵树当前占用的内存字节数（估算）：arena按已申请的块计算，
+          加上arena之外的节点内容、TreeBlock，以及编解码时重复使用的缓冲区
+          */
+        size_t memoryUsage() const
+        {
+            size_t size = sizeof(TreeCode);
+            if (arena != NULL)
+                size += sizeof(TreeArena) + arena->capacity();
+            for (unsigned int i=0;i<workerArenas.size();i++)
+                size += sizeof(TreeArena) + workerArenas[i]->capacity();
+            size += workerArenas.capacity() * sizeof(TreeArena*);
+
+            vector<const Node*> stack;
+            if (rootNode != NULL)
+                stack.push_back(rootNode);
+            while (!stack.empty())
+            {
+                const Node* n = stack.back();
+                stack.pop_back();
+                size += n->heapSize();
+                for (unsigned int i=0;i<n->sons.size();i++)
+                    stack.push_back(n->sons[i]);
+            }
+
+            size += workStack.capacity() * sizeof(Node::Frame) + destroyStack.capacity() * sizeof(Node*);
+            size += packBuffer.capacity() + packOutput.capacity() + printBuffer.capacity();
+            size += encodeCache[0].capacity() + encodeCache[1].capacity() + cacheStack.capacity() * sizeof(CacheFrame);
+            size += nameTable.ids.bucket_count() * sizeof(void*) + nameTable.ids.size() * (sizeof(Node::NameTable::IdMap::value_type) + sizeof(void*));
+            size += nameTable.order.capacity() * sizeof(TreeSlice) + nameTable.names.capacity() * sizeof(string);
+            return size;
+        }
+
         Node* addEmptyNode(const string& name)
         {
-            Node* node = new Node();
+            Node* node = Node::create(arena);
+            node->name.assign(name.data(),name.size());
             if (rootNode == NULL)
             {
                 focusNode = rootNode = node;
             }
             else
             {
-                focusNode->sons.push_back(node);
-                node->parent = focusNode;
+                focusNode->addSon(node);
             }
-            node->name = name;
             node->setEmptyObj();
             return node;
         }
@@ -614,7 +2165,8 @@ class TreeCode
         template<typename T>
             Node* addNode(const string& name, const T& v,bool isChangeFocus=false)
             {
-                Node* node = new (std::nothrow) Node();
+                Node* node = Node::create(arena);
+                node->name.assign(name.data(),name.size());
                 if (rootNode == NULL)
                 {
                     focusNode = rootNode = node;
@@ -622,10 +2174,8 @@ class TreeCode
                 else
                 {
                     //printf("addNode,focusNode[%s],node[%s]\n",focusNode->name.c_str(),name.c_str());
-                    focusNode->sons.push_back(node);
-                    node->parent = focusNode;
+                    focusNode->addSon(node);
                 }
-                node->name = name;
                 node->setObj(v);
                 if(isChangeFocus){
                     focusNode = node;
@@ -660,9 +2210,9 @@ class TreeCode
             }
             if (!name.empty())
             {
-                if(focusNode->parent->name != name)
+                if(focusNode->parent->name.compare(0,Node::NodeString::npos,name.data(),name.size()) != 0)
                 {
-                    string msg=string("不是预期的父节点 name:")+name+" 实际:"+focusNode->parent->name;
+                    string msg=string("不是预期的父节点 name:")+name+" 实际:"+focusNode->parent->name.c_str();
                     assert(!msg.c_str());
                 }
             }               
@@ -690,11 +2240,10 @@ class TreeCode
           */
         Node* getSon(const string& name, bool boolAssert=false)
         {
-            for (unsigned int i=0;i<focusNode->sons.size();i++)
-            {
-                if (focusNode->sons[i]->name == name)                
-                    return focusNode = focusNode->sons[i];                
-            }
+            Node* son = focusNode->findSon(name.data(),name.size());
+            if (son != NULL)
+                return focusNode = son;
+            TREECODE_STAT_ADD(TC_STAT_LOOKUP_MISSES,1);
             if (boolAssert)
                 assert(!(string("cant' find node :") + name).c_str());
 
@@ -754,92 +2303,195 @@ class TreeCode
             return focusNode;
         }
 
-        //读取当前节点的值
+        /*读取当前节点的值
+          数组节点可以读成TreeSpan<T>（指向节点内的元素，不拷贝，节点修改或释放后失效）或vector<T>
+          */
         template<typename T>
             bool read(T& t)
             {
-                try
+                if(!focusNode->get(t))
                 {
-                    t = boost::any_cast<T>(focusNode->obj);
-                }			
-                catch(...)
-                {
-                    DEBUG_LOG("read node[%s]----type[%u],catch error....",focusNode->name.c_str(),focusNode->type);
-                    ERROR_LOG("read node[%s]----type[%u],catch error....",focusNode->name.c_str(),focusNode->type);
+                    TREECODE_STAT_ADD(TC_STAT_READ_MISMATCHES,1);
+                    DEBUG_LOG("read node[%s]----type[%u],type mismatch....",focusNode->name.c_str(),focusNode->type);
+                    ERROR_LOG("read node[%s]----type[%u],type mismatch....",focusNode->name.c_str(),focusNode->type);
                     return false;
                 }
                 return true;
             }
-        //读取当前节点的值,当节点是一个buffer时使用
-        void read(void*& p,unsigned int& len)
+        /*读取当前节点的值,当节点是一个buffer时使用
+          p指向节点中的内容，节点修改或释放后失效；需要在节点之外保留时读成TreeBuffer
+          */
+        bool read(void*& p,unsigned int& len)
         {
-            buffer_t buff =boost::any_cast<buffer_t>(focusNode->obj);
+            buffer_t buff = buffer_t();
+            if(!focusNode->get(buff))
+            {
+                p=NULL;
+                len=0;
+                TREECODE_STAT_ADD(TC_STAT_READ_MISMATCHES,1);
+                ERROR_LOG("read node[%s]----type[%u],type mismatch....",focusNode->name.c_str(),focusNode->type);
+                return false;
+            }
             p=buff.p;
             len=buff.len;
+            return true;
         }
         //得到当前节点的名称
         string getName()
         {
-            return focusNode->name;
+            return string(focusNode->name.data(),focusNode->name.size());
         }
-        /*
-        //从文件载入
+        /*从文件载入，原有的树会被清空
+          文件整个映射到内存后直接解码，不先读入自己的缓冲区；只需要读取部分内容时
+          可以用TreeCodeMappedFile映射后建立TreeCodeView，完全不拷贝
+          */
         bool load(const string& filename)
         {
-        rootNode = focusNode = new Node();
-        ifstream inFile(filename.c_str());
-
-        //assert(inFile.is_open());
-        if(!inFile.is_open())
-        return false;
-
-        rootNode->load(inFile);
-
-        focusNode = rootNode;
-        inFile.close();
-        return true;
-        }       
-        //从一个内存流载入
-        void load(istream& stream)
-        {
-        stream.seekg(ios::beg);			
-        rootNode = focusNode = new Node();
-        rootNode->load(stream);
-        focusNode = rootNode;
+            reset();
+            TreeCodeMappedFile file;
+            if (!file.open(filename))
+            {
+                ERROR_LOG("treecode open file failed, file[%s]",filename.c_str());
+                return loadFailed();
+            }
+            if (file.size() == 0 || file.size() > 0xFFFFFFFFu)
+            {
+                ERROR_LOG("treecode file empty or too large, file[%s]",filename.c_str());
+                return loadFailed();
+            }
+            return load(file.data(),(UInt32)file.size());
         }
-        */
 
-        void load(void* data,UInt32 len,UInt32 offset)
+        bool load(void* data,UInt32 len,UInt32 offset)
         {
             void* ptr = (char*)data + offset;
             UInt32 nowLen = len - offset;
-            load(ptr,nowLen);
+            return load(ptr,nowLen);
         }
 
-        //从一段内存中载入
-        void load(void* data,UInt32 len)
+        //从一段内存中载入，原有的树会被清空；格式不支持或深度超过限制时返回false
+        bool load(void* data,UInt32 len)
         {
-            rootNode = focusNode = new Node();
-            rootNode->load(data,len);
-            focusNode = rootNode;
+            TREECODE_STAT_TIMER(TC_STAT_LOAD_NS);
+            TREECODE_STAT_ADD(TC_STAT_BYTES_DECODED,len);
+            bool ret = decode(data,len);
+            TREECODE_STAT_ADD(ret ? TC_STAT_LOADS : TC_STAT_LOAD_FAILURES,1);
+            return ret;
+        }
+        /*只检查消息、不解码，规则与load相同（包括深度和buffer长度限制），result给出消息的规模
+          压缩的消息先解压到内部的缓冲区再检查
+          */
+        bool validate(const void* data,UInt32 len,Node::ScanResult& result)
+        {
+            unsigned char flags = 0;
+            if (readTreeCodeHeader(data,len,flags) && (flags & TC_FLAG_COMPRESSED))
+            {
+                if (!decompressTreeCode(data,len,packBuffer))
+                    return false;
+                data = &packBuffer[0];
+                len = packBuffer.size();
+            }
+            return Node::scan(data,len,scanBuffer,maxDepth,maxBufferLen,result);
+        }
+        /*保存到文件
+          \flags 为0时按v1格式保存，否则写消息头并按flags编码，见TreeCodeFormat.h
+          先算出编码长度，预分配文件后直接编码到文件的映射中；压缩时编码到内存后一次写入
+          */
+        bool save(const string& filename,unsigned char flags = 0)
+        {
+            if (rootNode == NULL)
+                return false;
+            TREECODE_STAT_TIMER(TC_STAT_ENCODE_NS);
+            TREECODE_STAT_ADD(TC_STAT_ENCODES,1);
+            if (flags & TC_FLAG_COMPRESSED)
+            {
+                TreeCodeFileSink sink;
+                if (!sink.open(filename))
+                {
+                    ERROR_LOG("treecode open file failed, file[%s]",filename.c_str());
+                    return false;
+                }
+                size_t packed = outCompressed(sink,flags);
+                if (packed > 0)
+                {
+                    TREECODE_STAT_ADD(TC_STAT_BYTES_ENCODED,packed);
+                    return sink.close();
+                }
+                flags &= ~TC_FLAG_COMPRESSED;
+            }
+            size_t size = encodedSize(flags);
+            TREECODE_STAT_ADD(TC_STAT_BYTES_ENCODED,size);
+            TreeCodeMappedFile file;
+            if (!file.create(filename,size))
+            {
+                ERROR_LOG("treecode create file failed, file[%s] size[%u]",filename.c_str(),(unsigned int)size);
+                return false;
+            }
+            RawWriter writer(file.data());
+            if (flags != 0)
+                writeTreeCodeHeader(writer,flags);
+            outBody(writer,flags);
+            assert(writer.size() == size);
+            return file.close();
         }
-        //保存到文件
-        void save(const string& filename)
+        void out(Stream& st,unsigned char flags = 0)
+        {
+            out<Stream>(st,flags);
+        }
+        template<typename S>
+            void out(S& st,unsigned char flags)
+            {
+                TREECODE_STAT_TIMER(TC_STAT_ENCODE_NS);
+                TREECODE_STAT_ADD(TC_STAT_ENCODES,1);
+#ifdef TREECODE_STATS
+                TreeCodeCountingWriter<S> counter(st);
+                outTo(counter,flags);
+                TREECODE_STAT_ADD(TC_STAT_BYTES_ENCODED,counter.size());
+#else
+                outTo(st,flags);
+#endif
+            }
+        //按flags编码后的准确字节数（包括消息头），同时记录每个节点的子树长度；不压缩
+        size_t encodedSize(unsigned char flags = 0)
         {
-            ofstream outFile(filename.c_str());			
-            rootNode->save(outFile);
-            outFile.close();
+            flags &= ~TC_FLAG_COMPRESSED;
+            if (rootNode == NULL)
+                return 0;
+            size_t size = (flags != 0) ? TREECODE_HEADER_SIZE : 0;
+            if (useEncodeCache(flags))
+                return size + encodeCached(flags).size();
+            if (flags & TC_FLAG_NAME_TABLE)
+                size += rootNode->buildNameTable(nameTable,workStack);
+            return size + rootNode->computeSize(flags,workStack);
         }
-        void out(Stream& st)
+
+        /*一次性编码到调用者提供的连续内存，不经过Stream；不压缩
+          \return 写入的字节数，cap不够时返回0且不写入
+          */
+        size_t serializeTo(void* dst,size_t cap,unsigned char flags = 0)
         {
-            rootNode->save(st);
+            flags &= ~TC_FLAG_COMPRESSED;
+            TREECODE_STAT_TIMER(TC_STAT_ENCODE_NS);
+            size_t size = encodedSize(flags);
+            if (size == 0 || size > cap)
+                return 0;
+            TREECODE_STAT_ADD(TC_STAT_ENCODES,1);
+            TREECODE_STAT_ADD(TC_STAT_BYTES_ENCODED,size);
+            RawWriter writer(dst);
+            if (flags != 0)
+                writeTreeCodeHeader(writer,flags);
+            outBody(writer,flags);
+            assert(writer.size() == size);
+            return size;
         }
+
+        //输出到日志，使用重复利用的缓冲区
         void dump()
         {
             DEBUG_LOG("treecodeDump start:###########################################");
-            string log;
-            print(log,rootNode,0);
-            DEBUG_LOG("%s",log.c_str());
+            printBuffer.clear();
+            print(printBuffer,rootNode,0);
+            DEBUG_LOG("%s",printBuffer.c_str());
             DEBUG_LOG("treecodeDump end:###########################################");
         }
         string print()
@@ -848,31 +2500,119 @@ class TreeCode
             print(log,rootNode,0);
             return log;
         }
-        void toString(string out)
+        //输出到out，原有内容被清空；out可以重复使用避免分配
+        void toString(string& out)
         {
             out.clear();
             print(out,rootNode,0);
         }
+        /*紧凑的JSON格式输出到out，原有内容被清空：
+          没有子节点的节点是"名称":内容，有子节点的节点是"名称":{"@":内容,子节点...}，内容为Empty时省略"@"；
+          同名的兄弟节点输出为重复的键
+          */
+        void toJson(string& out)
+        {
+            out.clear();
+            printJson(out,rootNode);
+        }
+        string toJson()
+        {
+            string out;
+            printJson(out,rootNode);
+            return out;
+        }
+        //非递归输出以p为根的子树，level是p的缩进层数，追加到log
         void print(string& log,Node* p,size_t level)
         {				
-            string space="	";
-            for (size_t i=0;i<level;i++)				log+=space;
-            log+=p->name+"="+p->printAny();			
+            if (p == NULL)
+                return;
+            Node::WorkStack& stack = workStack;
+            stack.clear();
+            printNode(log,p,level);
             if(!p->sons.empty())
+                stack.push_back(Node::Frame(p,0));
+            while (!stack.empty())
             {
-                log+="\n";
-                for (size_t i=0;i<level;i++)				log+=space;
-                log+="|\n";
-                for(size_t i=0;i<p->sons.size();i++)
+                Node::Frame& f = stack.back();
+                if (f.next == f.node->sons.size())
                 {
-                    print(log,p->sons[i],level+1);
+                    stack.pop_back();
+                    if (!stack.empty())
+                        log+="\n";
+                    continue;
+                }
+                Node* n = f.node->sons[f.next++];
+                printNode(log,n,level + stack.size());
+                if (n->sons.empty())
                     log+="\n";
+                else
+                    stack.push_back(Node::Frame(n,0));
+            }
+        }
+
+    private:		
+        //输出单个节点，有子节点时后面跟上"|"行
+        void printNode(string& log,Node* p,size_t level)
+        {
+            log.append(level,'\t');
+            log.append(p->name.data(),p->name.size());
+            log+='=';
+            p->appendValue(log);
+            if(!p->sons.empty())
+            {
+                log+='\n';
+                log.append(level,'\t');
+                log+="|\n";
+            }
+        }
+
+        //非递归输出以p为根的子树的JSON，追加到out
+        void printJson(string& out,Node* p)
+        {
+            out += '{';
+            if (p != NULL && jsonOpen(out,p))
+            {
+                Node::WorkStack& stack = workStack;
+                stack.clear();
+                stack.push_back(Node::Frame(p,0));
+                while (!stack.empty())
+                {
+                    Node::Frame& f = stack.back();
+                    if (f.next == f.node->sons.size())
+                    {
+                        out += '}';
+                        stack.pop_back();
+                        continue;
+                    }
+                    if (f.next > 0 || f.node->type != Node::Empty)
+                        out += ',';
+                    Node* n = f.node->sons[f.next++];
+                    if (jsonOpen(out,n))
+                        stack.push_back(Node::Frame(n,0));
                 }
             }
+            out += '}';
+        }
 
+        //输出"名称":，没有子节点时接着输出内容并返回false，有子节点时输出{和"@":内容并返回true
+        bool jsonOpen(string& out,Node* n)
+        {
+            Node::appendJsonString(out,n->name.data(),n->name.size());
+            out += ':';
+            if (n->sons.empty())
+            {
+                n->appendJson(out);
+                return false;
+            }
+            out += '{';
+            if (n->type != Node::Empty)
+            {
+                out += "\"@\":";
+                n->appendJson(out);
+            }
+            return true;
         }
 
-    private:		
         vector<string> split(const string& str,const char* c)
         {
             char *cstr, *p;
@@ -888,8 +2628,204 @@ class TreeCode
             return res;
         }
     private:
+        template<typename S>
+            void outTo(S& st,unsigned char flags)
+            {
+                if (flags & TC_FLAG_COMPRESSED)
+                {
+                    if (outCompressed(st,flags))
+                        return;
+                    flags &= ~TC_FLAG_COMPRESSED;
+                }
+                if (flags != 0)
+                {
+                    writeTreeCodeHeader(st,flags);
+                    if (flags & TC_FLAG_NAME_TABLE)
+                        rootNode->buildNameTable(nameTable,workStack);
+                    if ((flags & TC_FLAG_SUBTREE_SIZE) && !useEncodeCache(flags))
+                        rootNode->computeSize(flags,workStack);
+                }
+                outBody(st,flags);
+            }
+
+        /*按去掉TC_FLAG_COMPRESSED的flags编码后整体压缩输出，返回输出的字节数
+          太小时返回0，由调用者按不压缩输出；压缩后没有变小时直接输出未压缩的编码
+          */
+        template<typename S>
+            size_t outCompressed(S& st,unsigned char flags)
+            {
+                unsigned char inner = flags & ~TC_FLAG_COMPRESSED;
+                size_t size = encodedSize(inner) - (inner != 0 ? TREECODE_HEADER_SIZE : 0);
+                if (size < compressThreshold)
+                    return 0;
+                packBuffer.resize(size);
+                RawWriter writer(&packBuffer[0]);
+                outBody(writer,inner);
+                size_t packed = compressTreeCode(&packBuffer[0],size,inner,packOutput);
+                if (packed > 0)
+                {
+                    st.write(&packOutput[0],packed);
+                    return packed;
+                }
+                if (inner != 0)
+                    writeTreeCodeHeader(st,inner);
+                st.write(&packBuffer[0],size);
+                return (inner != 0 ? TREECODE_HEADER_SIZE : 0) + size;
+            }
+
+        //解码失败时清空原有的树并留下空的根节点，之后的访问和解码成功时一样不会遇到NULL
+        bool loadFailed()
+        {
+            reset();
+            rootNode = focusNode = Node::create(arena);
+            return false;
+        }
+
+        //load的实现，统计在load中
+        bool decode(void* data,UInt32 len)
+        {
+            reset();
+            unsigned char flags = 0;
+            if (readTreeCodeHeader(data,len,flags) && (flags & TC_FLAG_COMPRESSED))
+            {
+                if (!decompressTreeCode(data,len,packBuffer))
+                {
+                    ERROR_LOG("treecode decompress failed, len[%u]",len);
+                    return loadFailed();
+                }
+                data = &packBuffer[0];
+                len = packBuffer.size();
+            }
+            if (validateInput)
+            {
+                Node::ScanResult info;
+                bool valid = Node::scan(data,len,scanBuffer,maxDepth,maxBufferLen,info);
+                if (valid && arena != NULL)
+                    arena->reserve(info.arenaBytes);
+                if (!valid)
+                    return loadFailed();
+                rootNode = focusNode = Node::create(arena);
+            }
+            else
+            {
+                rootNode = focusNode = Node::create(arena);
+            }
+            bool ret = rootNode->load(data,len,workStack,maxDepth,maxBufferLen);
+            focusNode = rootNode;
+            return ret;
+        }
+
+        //消息头之后的部分，名称表和子树长度需要已经准备好
+        template<typename S>
+            void outBody(S& st,unsigned char flags)
+            {
+                if (useEncodeCache(flags))
+                {
+                    const vector<char>& body = encodeCached(flags);
+                    st.write(&body[0],body.size());
+                    return;
+                }
+                if (flags & TC_FLAG_NAME_TABLE)
+                    Node::writeNameTable(st,nameTable);
+                rootNode->save(st,flags,workStack);
+            }
+
+        bool useEncodeCache(unsigned char flags) const
+        {
+            return cacheEnabled && rootNode != NULL && !(flags & (TC_FLAG_NAME_TABLE | TC_FLAG_COMPRESSED));
+        }
+
+        //增量编码时的栈帧，记录节点在旧缓存和新缓存中的起始位置
+        struct CacheFrame
+        {
+            Node* node;
+            unsigned int next;
+            size_t oldStart;
+            size_t newStart;
+            CacheFrame(Node* node,size_t oldStart,size_t newStart):node(node),next(0),oldStart(oldStart),newStart(newStart) {}
+        };
+
+        /*非递归地把整棵树按flags编码到缓存中（不含消息头），返回编码结果，下次编码前有效
+          干净的子树从上次的缓存整段拷贝，失效的节点重新编码；flags和上次不同时全部重新编码
+          */
+        const vector<char>& encodeCached(unsigned char flags)
+        {
+            bool full = (cacheFlags != flags);
+            const vector<char>& old = encodeCache[cacheCur];
+            if (!full && !rootNode->dirty)
+                return old;
+            vector<char>& buff = encodeCache[1 - cacheCur];
+            buff.clear();
+            buff.reserve(old.size());
+            VectorWriter writer(buff);
+
+            cacheStack.clear();
+            rootNode->cacheOffset = 0;
+            rootNode->saveSelf(writer,flags);
+            cacheStack.push_back(CacheFrame(rootNode,0,0));
+            while (!cacheStack.empty())
+            {
+                CacheFrame& f = cacheStack.back();
+                Node* p = f.node;
+                if (f.next == p->sons.size())
+                {
+                    finishCached(p,f.newStart,flags);
+                    cacheStack.pop_back();
+                    continue;
+                }
+                Node* n = p->sons[f.next++];
+                size_t oldStart = f.oldStart + n->cacheOffset;
+                size_t newStart = buff.size();
+                n->cacheOffset = newStart - f.newStart;
+                if (!full && !n->dirty)
+                {
+                    writer.write(&old[oldStart],n->cacheLen);
+                    continue;
+                }
+                n->saveSelf(writer,flags);
+                if (n->sons.empty())
+                    finishCached(n,newStart,flags);
+                else
+                    cacheStack.push_back(CacheFrame(n,oldStart,newStart));
+            }
+            cacheFlags = flags;
+            cacheCur = 1 - cacheCur;
+            return buff;
+        }
+
+        //节点及其子树已经写完：记录长度，补上子树长度字段
+        void finishCached(Node* n,size_t start,unsigned char flags)
+        {
+            vector<char>& buff = encodeCache[1 - cacheCur];
+            n->cacheLen = buff.size() - start;
+            n->dirty = false;
+            if (flags & TC_FLAG_SUBTREE_SIZE)
+            {
+                n->treeSize = n->cacheLen - sizeof(n->treeSize);
+                memcpy(&buff[start],&n->treeSize,sizeof(n->treeSize));
+            }
+        }
+
         Node* focusNode;
         Node* rootNode;
+        TreeArena* arena;//NULL表示不使用arena
+        unsigned int maxDepth;//解码时允许的最大深度
+        unsigned int maxBufferLen;//解码时buffer和数组内容允许的最大字节数
+        bool validateInput;//解码前是否先检查消息
+        Node::ScanBuffer scanBuffer;//检查消息用的栈，重复使用
+        Node::WorkStack workStack;//非递归遍历用的栈，重复使用
+        vector<Node*> destroyStack;
+        unsigned int compressThreshold;
+        vector<char> packBuffer;//压缩前或解压后的数据，重复使用
+        vector<char> packOutput;//压缩结果，重复使用
+        Node::NameTable nameTable;//编码时的名称表，重复使用
+        vector<TreeArena*> workerArenas;//启用arena时并行解码的每个线程各用一个，和arena一起reset
+        bool cacheEnabled;//是否启用编码缓存
+        int cacheFlags;//缓存中编码使用的flags，-1表示没有缓存
+        vector<char> encodeCache[2];//上次和本次的编码结果，交替使用
+        unsigned int cacheCur;//encodeCache中哪个是上次的结果
+        vector<CacheFrame> cacheStack;
+        string printBuffer;//dump的输出，重复使用
 
 };
 
@@ -0,0 +1,232 @@
+#ifndef _TREE_CODE_BATCH_H__
+#define _TREE_CODE_BATCH_H__
+
+#include <fstream>
+#include "TreeCode.h"
+
+/*多条TreeCode消息打包在一起，末尾是索引：
+  消息0 消息1 ... 消息N-1 | N个4字节偏移 | 4字节消息数N | 4字节标记"TCB1"
+  偏移从批量数据开头算起，消息i的长度是下一条消息（或索引）的偏移减去自己的偏移；
+  每条消息仍是完整的TreeCode编码（v1或v2，可以压缩），可以单独取出解码
+  */
+enum
+{
+    TREECODE_BATCH_MAGIC = 0x31424354,//"TCB1"
+    TREECODE_BATCH_TAIL = 2 * sizeof(unsigned int),//消息数和标记
+};
+
+/*批量数据的只读访问，不拷贝；按下标取消息是O(1)
+  for (unsigned int i=0;i<batch.count();i++) tree.load(batch[i]...)
+  */
+class TreeCodeBatch
+{
+    public:
+        TreeCodeBatch():base(NULL),index(NULL),num(0),indexPos(0)
+        {
+
+        }
+
+        TreeCodeBatch(const void* data,size_t len):base(NULL),index(NULL),num(0),indexPos(0)
+        {
+            load(data,len);
+        }
+
+        //检查末尾的索引，数据不合法时返回false
+        bool load(const void* data,size_t len)
+        {
+            base = (const unsigned char*)data;
+            index = NULL;
+            num = 0;
+            indexPos = 0;
+            if (len < TREECODE_BATCH_TAIL)
+                return false;
+            unsigned int n = 0;
+            unsigned int magic = 0;
+            memcpy(&n,base + len - TREECODE_BATCH_TAIL,sizeof(n));
+            memcpy(&magic,base + len - sizeof(magic),sizeof(magic));
+            if (magic != TREECODE_BATCH_MAGIC || n > (len - TREECODE_BATCH_TAIL) / sizeof(unsigned int))
+                return false;
+            size_t pos = len - TREECODE_BATCH_TAIL - (size_t)n * sizeof(unsigned int);
+            const unsigned char* idx = base + pos;
+
+            //偏移必须递增且都在索引之前
+            unsigned int last = 0;
+            for (unsigned int i=0;i<n;i++)
+            {
+                unsigned int off = 0;
+                memcpy(&off,idx + i * sizeof(off),sizeof(off));
+                if (off < last || off > pos)
+                    return false;
+                last = off;
+            }
+            index = idx;
+            num = n;
+            indexPos = pos;
+            return true;
+        }
+
+        unsigned int count() const
+        {
+            return num;
+        }
+
+        //第i条消息的编码数据
+        TreeSlice operator[](unsigned int i) const
+        {
+            if (i >= num)
+                return TreeSlice();
+            size_t begin = offset(i);
+            size_t end = (i + 1 < num) ? offset(i + 1) : indexPos;
+            return TreeSlice(base + begin,end - begin);
+        }
+
+        //解码第i条消息
+        bool load(unsigned int i,TreeCode& tree) const
+        {
+            TreeSlice s = (*this)[i];
+            if (i >= num || s.empty())
+                return false;
+            return tree.load((void*)s.data,s.size());
+        }
+
+        //所有消息数据的长度，不含索引
+        size_t bodySize() const
+        {
+            return indexPos;
+        }
+
+    private:
+        size_t offset(unsigned int i) const
+        {
+            unsigned int off = 0;
+            memcpy(&off,index + i * sizeof(off),sizeof(off));
+            return off;
+        }
+
+        const unsigned char* base;
+        const unsigned char* index;//偏移数组
+        unsigned int num;
+        size_t indexPos;
+};
+
+//追加消息并在finish时写出索引
+class TreeCodeBatchWriter
+{
+    public:
+        TreeCodeBatchWriter():finished(false)
+        {
+
+        }
+
+        void reset()
+        {
+            buff.clear();
+            offsets.clear();
+            finished = false;
+        }
+
+        /*在已有的批量数据后面继续追加，原有的消息不会重新编码
+          数据不合法时返回false且保持为空
+          */
+        bool open(const void* data,size_t len)
+        {
+            reset();
+            TreeCodeBatch batch;
+            if (!batch.load(data,len))
+                return false;
+            const char* p = (const char*)data;
+            buff.assign(p,p + batch.bodySize());
+            for (unsigned int i=0;i<batch.count();i++)
+                offsets.push_back(batch[i].data - (const unsigned char*)data);
+            return true;
+        }
+
+        //按flags编码后追加一棵树
+        bool append(TreeCode& tree,unsigned char flags = 0)
+        {
+            if (!begin())
+                return false;
+            tree.out(*this,flags);
+            return true;
+        }
+
+        //追加一条已经编码好的消息
+        bool append(const void* msg,size_t len)
+        {
+            if (!begin())
+                return false;
+            write((const char*)msg,len);
+            return true;
+        }
+
+        //写出索引，之后data()/size()是完整的批量数据；再追加前需要reset或open
+        void finish()
+        {
+            if (finished)
+                return;
+            for (unsigned int i=0;i<offsets.size();i++)
+                writeU32(offsets[i]);
+            writeU32(offsets.size());
+            writeU32(TREECODE_BATCH_MAGIC);
+            finished = true;
+        }
+
+        unsigned int count() const
+        {
+            return offsets.size();
+        }
+
+        const char* data() const
+        {
+            return buff.empty() ? NULL : &buff[0];
+        }
+
+        size_t size() const
+        {
+            return buff.size();
+        }
+
+        void out(Stream& st)
+        {
+            finish();
+            if (!buff.empty())
+                st.write(&buff[0],buff.size());
+        }
+
+        //一次写入文件
+        bool save(const string& filename)
+        {
+            finish();
+            ofstream outFile(filename.c_str(),ios::binary);
+            if (!outFile.is_open())
+                return false;
+            outFile.write(data(),size());
+            return outFile.good();
+        }
+
+        //接口与Stream::write相同，供TreeCode::out写入
+        void write(const char* p,size_t n)
+        {
+            buff.insert(buff.end(),p,p + n);
+        }
+
+    private:
+        bool begin()
+        {
+            if (finished || buff.size() > 0xFFFFFFFFu)
+                return false;
+            offsets.push_back(buff.size());
+            return true;
+        }
+
+        void writeU32(unsigned int v)
+        {
+            write((const char*)&v,sizeof(v));
+        }
+
+        vector<char> buff;
+        vector<unsigned int> offsets;//每条消息的起始位置
+        bool finished;
+};
+
+#endif
@@ -0,0 +1,718 @@
+/*TreeCode基准测试，单独编译运行，不属于库本身：
+    g++ -std=c++98 -O2 -DNDEBUG TreeCodeBench.cpp -o treecode_bench -lboost_thread -lboost_system -lpthread
+    ./treecode_bench [名称过滤] [每项最少运行毫秒数，默认200]
+  构造几种典型形状的树（宽的记录表、深链、字符串、buffer、数值和数组），
+  测量各种flags下的编码、解码、查找和打印。每项结果输出一行JSON，便于脚本比较前后两次的结果：
+    {"shape":"wide","op":"decode","flags":2,"bytes":...,"nodes":...,"iters":...,"ns_per_op":...,
+     "mb_s":...,"nodes_s":...,"allocs_per_op":...,"alloc_bytes_per_op":...}
+  mb_s按编码后的长度计算（print/json按输出的长度）；nodes是每次操作处理的节点数，查找类的操作为1，nodes_s即每秒查找次数；
+  allocs只统计operator new（包括并行解码的工作线程），arena块用malloc分配不计入
+  对照项：parser是TreeCodeParser只扫描不建树，与decode比较；decode_parallel/tN用N个线程并行解码，
+  N从1到硬件线程数，只有一个硬件线程时不测；print_recursive是改成非递归之前的print（递归、字符串拼接、
+  每个值lexical_cast），与print比较。改成非递归之前的解码依赖Node内部已经不存在的实现，无法在这里对照
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include <string>
+#include <vector>
+#include "TreeCode.h"
+#include "TreeCodeView.h"
+#include "TreeCodeDecoder.h"
+#include "TreeCodeParallel.h"
+#include "TreeCodeParser.h"
+
+using namespace std;
+
+//统计operator new的次数和字节数，并行解码的工作线程也会分配，计数用原子操作
+static volatile size_t g_allocs = 0;
+static volatile size_t g_allocBytes = 0;
+
+#if __cplusplus < 201103L
+#define BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NOTHROW throw()
+#else
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_NOTHROW noexcept
+#endif
+
+void* operator new(size_t n) BENCH_THROW_BAD_ALLOC
+{
+    __sync_fetch_and_add(&g_allocs,1);
+    __sync_fetch_and_add(&g_allocBytes,n);
+    void* p = malloc(n == 0 ? 1 : n);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t n) BENCH_THROW_BAD_ALLOC
+{
+    return operator new(n);
+}
+
+//不内联，否则编译器看到free释放operator new的结果会误报new/delete不匹配
+__attribute__((noinline)) void operator delete(void* p) BENCH_NOTHROW
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) BENCH_NOTHROW
+{
+    free(p);
+}
+
+static double nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//固定种子的随机数，每次运行生成相同的树
+static unsigned int g_seed = 12345;
+static unsigned int nextRand()
+{
+    g_seed = g_seed * 1103515245u + 12345u;
+    return g_seed >> 8;
+}
+
+static string randomString(size_t len)
+{
+    string s(len,' ');
+    for (size_t i=0;i<len;i++)
+        s[i] = 'a' + nextRand() % 26;
+    return s;
+}
+
+static string numName(const char* prefix,unsigned int i)
+{
+    char buff[32];
+    snprintf(buff,sizeof(buff),"%s%u",prefix,i);
+    return buff;
+}
+
+/*一种形状的测试数据
+  paths是查找用的路径，都指向leaf类型的节点，readSon在路径的父节点下读取最后一级
+  */
+struct Shape
+{
+    const char* name;
+    void (*build)(TreeCode& tree,Shape& shape);
+    Node::TypeCode leaf;
+    bool viewable;//深度不超过TreeCodeView::MAX_DEPTH
+    size_t nodes;
+    vector<string> paths;
+};
+
+//宽：20000条记录，每条8个字段
+static void buildWide(TreeCode& tree,Shape& shape)
+{
+    const unsigned int RECORDS = 20000;
+    tree.addEmptyNode("bench");
+    for (unsigned int i=0;i<RECORDS;i++)
+    {
+        tree.addEmptyNode(numName("r",i));
+        tree.getLastSon();
+        tree.addNode("id",(int)i);
+        tree.addNode("name",randomString(6 + nextRand() % 10));
+        tree.addNode("level",(unsigned int)(nextRand() % 100));
+        tree.addNode("exp",(int64_t)nextRand() * 1000);
+        tree.addNode("score",(double)(nextRand() % 100000) / 100);
+        tree.addNode("guild",(int)(nextRand() % 50));
+        tree.addNode("online",(int)(nextRand() & 1));
+        float3 pos = {(float)(nextRand() % 1000),0,(float)(nextRand() % 1000)};
+        tree.addNode("pos",pos);
+        tree.toParent();
+    }
+    shape.nodes = 1 + RECORDS * 9;
+    for (unsigned int i=0;i<256;i++)
+        shape.paths.push_back("/" + numName("r",nextRand() % RECORDS) + "/score");
+}
+
+//深：20条链，每条800层
+static void buildDeep(TreeCode& tree,Shape& shape)
+{
+    const unsigned int CHAINS = 20,DEPTH = 800;
+    tree.addEmptyNode("bench");
+    for (unsigned int c=0;c<CHAINS;c++)
+    {
+        tree.addNode(numName("c",c),(int)c,true);
+        for (unsigned int d=1;d<DEPTH;d++)
+            tree.addNode("d",(int)d,true);
+        tree.findNode("/");
+    }
+    shape.nodes = 1 + CHAINS * DEPTH;
+    for (unsigned int i=0;i<16;i++)
+    {
+        string path = "/" + numName("c",nextRand() % CHAINS);
+        unsigned int depth = 1 + nextRand() % (DEPTH - 1);
+        for (unsigned int d=0;d<depth;d++)
+            path += "/d";
+        shape.paths.push_back(path);
+    }
+}
+
+//字符串：500组，每组100个8~256字节的字符串
+static void buildStrings(TreeCode& tree,Shape& shape)
+{
+    const unsigned int GROUPS = 500,PER_GROUP = 100;
+    tree.addEmptyNode("bench");
+    for (unsigned int g=0;g<GROUPS;g++)
+    {
+        tree.addEmptyNode(numName("g",g));
+        tree.getLastSon();
+        for (unsigned int i=0;i<PER_GROUP;i++)
+            tree.addNode(numName("s",i),randomString(8 + nextRand() % 249));
+        tree.toParent();
+    }
+    shape.nodes = 1 + GROUPS * (PER_GROUP + 1);
+    for (unsigned int i=0;i<256;i++)
+        shape.paths.push_back("/" + numName("g",nextRand() % GROUPS) + "/" + numName("s",nextRand() % PER_GROUP));
+}
+
+//buffer：1000个512~16384字节的buffer
+static void buildBuffers(TreeCode& tree,Shape& shape)
+{
+    const unsigned int COUNT = 1000;
+    tree.addEmptyNode("bench");
+    for (unsigned int i=0;i<COUNT;i++)
+    {
+        TreeBuffer b(512 + nextRand() % (16384 - 512));
+        for (size_t k=0;k<b.size();k++)
+            b.data()[k] = (char)nextRand();
+        tree.addNode(numName("b",i),b);
+    }
+    shape.nodes = 1 + COUNT;
+    for (unsigned int i=0;i<256;i++)
+        shape.paths.push_back("/" + numName("b",nextRand() % COUNT));
+}
+
+//数值：5000组，每组各种数值类型和一个64个元素的数组
+static void buildNumeric(TreeCode& tree,Shape& shape)
+{
+    const unsigned int GROUPS = 5000;
+    tree.addEmptyNode("bench");
+    vector<int> ints(64);
+    vector<double> doubles(64);
+    for (unsigned int g=0;g<GROUPS;g++)
+    {
+        tree.addEmptyNode(numName("n",g));
+        tree.getLastSon();
+        tree.addNode("i32",(int)(nextRand() % 1000) - 500);
+        tree.addNode("u32",(unsigned int)nextRand());
+        tree.addNode("i64",(int64_t)nextRand() << 20);
+        tree.addNode("u64",(uint64_t)(nextRand() % 300));
+        tree.addNode("f",(float)(nextRand() % 10000) / 7);
+        tree.addNode("d",(double)nextRand() / 3);
+        for (size_t k=0;k<ints.size();k++)
+        {
+            ints[k] = nextRand() % 4096;
+            doubles[k] = (double)nextRand() / 11;
+        }
+        tree.addNode("ia",ints);
+        tree.addNode("da",doubles);
+        tree.toParent();
+    }
+    shape.nodes = 1 + GROUPS * 9;
+    for (unsigned int i=0;i<256;i++)
+        shape.paths.push_back("/" + numName("n",nextRand() % GROUPS) + "/d");
+}
+
+//命令行参数
+static const char* g_filter = NULL;
+static double g_minNs = 200e6;
+
+static string flagsName(const string& op,unsigned int flags)
+{
+    char buff[16];
+    snprintf(buff,sizeof(buff),"%u",flags);
+    return op + "/" + buff;
+}
+
+/*重复调用f直到运行时间超过g_minNs，输出一行结果
+  f是有operator()的对象，第一次调用作为预热不计入；nodes为0时取整棵树的节点数
+  */
+template<typename F>
+static void measure(const Shape& shape,const char* op,unsigned int flags,size_t bytes,F& f,size_t nodes = 0)
+{
+    string full = string(shape.name) + "/" + flagsName(op,flags);
+    if (g_filter != NULL && full.find(g_filter) == string::npos)
+        return;
+    f();
+    size_t iters = 0,batch = 1;
+    size_t allocs = __sync_fetch_and_add(&g_allocs,0),allocBytes = __sync_fetch_and_add(&g_allocBytes,0);
+    double start = nowNs(),elapsed = 0;
+    while (elapsed < g_minNs)
+    {
+        for (size_t i=0;i<batch;i++)
+            f();
+        iters += batch;
+        elapsed = nowNs() - start;
+        if (batch < 1024)
+            batch *= 2;
+    }
+    allocs = __sync_fetch_and_add(&g_allocs,0) - allocs;
+    allocBytes = __sync_fetch_and_add(&g_allocBytes,0) - allocBytes;
+    double ns = elapsed / iters;
+    if (nodes == 0)
+        nodes = shape.nodes;
+    printf("{\"shape\":\"%s\",\"op\":\"%s\",\"flags\":%u,\"bytes\":%lu,\"nodes\":%lu,\"iters\":%lu,"
+           "\"ns_per_op\":%.1f,\"mb_s\":%.2f,\"nodes_s\":%.0f,\"allocs_per_op\":%.2f,\"alloc_bytes_per_op\":%.0f}\n",
+           shape.name,op,flags,(unsigned long)bytes,(unsigned long)nodes,(unsigned long)iters,
+           ns,bytes * 1e3 / ns,nodes * 1e9 / ns,(double)allocs / iters,(double)allocBytes / iters);
+    fflush(stdout);
+}
+
+//编码到预先分配的内存
+struct EncodeBench
+{
+    TreeCode& tree;
+    unsigned char flags;
+    vector<char> out;
+
+    EncodeBench(TreeCode& tree,unsigned char flags):tree(tree),flags(flags)
+    {
+        out.resize(tree.encodedSize(flags));
+    }
+
+    void operator()()
+    {
+        if (tree.serializeTo(&out[0],out.size(),flags) == 0)
+            abort();
+    }
+};
+
+//压缩编码，输出到复用的vector
+struct CompressBench
+{
+    TreeCode& tree;
+    unsigned char flags;
+    vector<char> out;
+
+    CompressBench(TreeCode& tree,unsigned char flags):tree(tree),flags(flags)
+    {
+
+    }
+
+    void operator()()
+    {
+        out.clear();
+        VectorWriter w(out);
+        tree.out(w,flags);
+    }
+};
+
+//启用编码缓存，每次修改一个节点后重新编码
+struct CachedEncodeBench
+{
+    TreeCode& tree;
+    unsigned char flags;
+    const Shape& shape;
+    vector<char> out;
+    unsigned int n;
+
+    CachedEncodeBench(TreeCode& tree,unsigned char flags,const Shape& shape):tree(tree),flags(flags),shape(shape),n(0)
+    {
+        //变长编码时修改后的长度可能变化，留出余量
+        out.resize(tree.encodedSize(flags) + 4096);
+    }
+
+    void operator()()
+    {
+        Node* node = tree.findNode(shape.paths[n++ % shape.paths.size()]);
+        if (node == NULL)
+            abort();
+        switch (shape.leaf)
+        {
+            case Node::Double: node->setObj((double)n); break;
+            case Node::Int32: node->setObj((int)n); break;
+            case Node::UTF8String:
+                {
+                    string s;
+                    node->get(s);
+                    if (!s.empty())
+                        s[0] = 'a' + n % 26;
+                    node->setObj(s);
+                }
+                break;
+            default: node->markDirty(); break;
+        }
+        if (tree.serializeTo(&out[0],out.size(),flags) == 0)
+            abort();
+    }
+};
+
+//解码到复用的TreeCode
+struct DecodeBench
+{
+    TreeCode tree;
+    vector<char>& data;
+
+    DecodeBench(vector<char>& data,bool arena):data(data)
+    {
+        tree.setMaxDepth(4096);
+        if (arena)
+            tree.enableArena();
+    }
+
+    void operator()()
+    {
+        if (!tree.load(&data[0],data.size()))
+            abort();
+    }
+};
+
+//并行解码，需要子树长度
+struct ParallelDecodeBench
+{
+    TreeCode tree;
+    TreeCodeParallelLoader loader;
+    vector<char>& data;
+
+    ParallelDecodeBench(vector<char>& data,unsigned int threads):loader(threads),data(data)
+    {
+        tree.setMaxDepth(4096);
+        tree.enableArena();
+    }
+
+    void operator()()
+    {
+        if (!loader.load(tree,&data[0],data.size()))
+            abort();
+    }
+};
+
+//只统计节点数和内容长度，保证解析的结果被用到
+struct CountVisitor : public TreeCodeVisitor
+{
+    size_t nodes;
+    size_t bytes;
+
+    CountVisitor():nodes(0),bytes(0)
+    {
+
+    }
+
+    Action onNodeBegin(const TreeSlice& name,Node::TypeCode,const TreeSlice& value)
+    {
+        nodes++;
+        bytes += name.size() + value.size();
+        return CONTINUE;
+    }
+};
+
+//事件方式扫描，不建树
+struct ParserBench
+{
+    TreeCodeParser parser;
+    CountVisitor visitor;
+    vector<char>& data;
+
+    ParserBench(vector<char>& data):parser(4096),data(data)
+    {
+
+    }
+
+    void operator()()
+    {
+        if (parser.parse(&data[0],data.size(),visitor) != TreeCodeParser::PARSE_DONE)
+            abort();
+    }
+};
+
+//增量解码，每次送入4KB
+struct StreamDecodeBench
+{
+    TreeCode tree;
+    TreeCodeDecoder decoder;
+    vector<char>& data;
+
+    StreamDecodeBench(vector<char>& data):decoder(tree),data(data)
+    {
+        tree.setMaxDepth(4096);
+        tree.enableArena();
+    }
+
+    void operator()()
+    {
+        decoder.reset();
+        TreeCodeDecoder::Status s = TreeCodeDecoder::NEED_MORE;
+        for (size_t off = 0;off < data.size() && s == TreeCodeDecoder::NEED_MORE;off += 4096)
+            s = decoder.feed(&data[off],min((size_t)4096,data.size() - off));
+        if (s != TreeCodeDecoder::DONE)
+            abort();
+    }
+};
+
+//按路径查找
+struct FindBench
+{
+    TreeCode& tree;
+    const Shape& shape;
+    unsigned int n;
+
+    FindBench(TreeCode& tree,const Shape& shape):tree(tree),shape(shape),n(0)
+    {
+
+    }
+
+    void operator()()
+    {
+        if (tree.findNode(shape.paths[n++ % shape.paths.size()]) == NULL)
+            abort();
+    }
+};
+
+//找到父节点后用readSon读取最后一级，不改变当前节点
+struct ReadSonBench
+{
+    TreeCode& tree;
+    Node::TypeCode leaf;
+    vector<string> parents;
+    vector<string> sons;
+    unsigned int n;
+
+    ReadSonBench(TreeCode& tree,const Shape& shape):tree(tree),leaf(shape.leaf),n(0)
+    {
+        for (size_t i=0;i<shape.paths.size();i++)
+        {
+            const string& p = shape.paths[i];
+            size_t pos = p.rfind('/');
+            parents.push_back(pos == 0 ? "/" : p.substr(0,pos));
+            sons.push_back(p.substr(pos + 1));
+        }
+    }
+
+    void operator()()
+    {
+        size_t i = n++ % parents.size();
+        if (tree.findNode(parents[i]) == NULL)
+            abort();
+        bool ok = false;
+        switch (leaf)
+        {
+            case Node::Double: { double v; ok = tree.readSon(sons[i],v); } break;
+            case Node::Int32: { int v; ok = tree.readSon(sons[i],v); } break;
+            case Node::UTF8String: { string v; ok = tree.readSon(sons[i],v); } break;
+            case Node::Buffer: { TreeBuffer v; ok = tree.readSon(sons[i],v); } break;
+            default: break;
+        }
+        if (!ok)
+            abort();
+    }
+};
+
+//在编码数据上直接查找
+struct ViewFindBench
+{
+    TreeCodeView view;
+    const Shape& shape;
+    unsigned int n;
+
+    ViewFindBench(vector<char>& data,const Shape& shape):view(&data[0],data.size()),shape(shape),n(0)
+    {
+        if (!view.valid())
+            abort();
+    }
+
+    void operator()()
+    {
+        view.toRoot();
+        if (view.findNode(shape.paths[n++ % shape.paths.size()]) == NULL)
+            abort();
+    }
+};
+
+//打印到复用的缓冲区
+struct PrintBench
+{
+    TreeCode& tree;
+    bool json;
+    string out;
+
+    PrintBench(TreeCode& tree,bool json):tree(tree),json(json)
+    {
+
+    }
+
+    void operator()()
+    {
+        if (json)
+            tree.toJson(out);
+        else
+            tree.toString(out);
+    }
+};
+
+//改成非递归之前printAny的做法：按类型取值后lexical_cast，没有数组和向量的格式
+static string refValue(Node* n)
+{
+#define REF_VALUE(T) { T v; if (n->get(v)) return boost::lexical_cast<string>(v); }
+    bool b;
+    if (n->get(b))
+        return b ? "true" : "false";
+    unsigned char c;
+    if (n->get(c))
+        return boost::lexical_cast<string>((unsigned short)c);
+    REF_VALUE(short) REF_VALUE(unsigned short) REF_VALUE(int) REF_VALUE(unsigned int)
+        REF_VALUE(int64_t) REF_VALUE(uint64_t) REF_VALUE(float) REF_VALUE(double)
+#undef REF_VALUE
+    string str;
+    if (n->get(str))
+        return str;
+    buffer_t buff;
+    if (n->get(buff))
+        return string("buffer[") + boost::lexical_cast<string>(buff.len) + "]";
+    return "";
+}
+
+//改成非递归之前的print：每层递归一次，缩进逐个拼接，p是tree的当前节点
+static void refPrint(string& log,TreeCode& tree,Node* p,size_t level)
+{
+    string space = "\t";
+    for (size_t i=0;i<level;i++)
+        log += space;
+    log += tree.getName() + "=" + refValue(p);
+    int num = tree.getSonNum();
+    if (num > 0)
+    {
+        log += "\n";
+        for (size_t i=0;i<level;i++)
+            log += space;
+        log += "|\n";
+        for (int i=0;i<num;i++)
+        {
+            Node* son = tree.getSon(i);
+            refPrint(log,tree,son,level + 1);
+            tree.toParent();
+            log += "\n";
+        }
+    }
+}
+
+struct RefPrintBench
+{
+    TreeCode& tree;
+    string out;
+
+    RefPrintBench(TreeCode& tree):tree(tree)
+    {
+
+    }
+
+    void operator()()
+    {
+        out.clear();
+        refPrint(out,tree,tree.findNode("/"),0);
+    }
+};
+
+//并行解码测到的最多线程数，只有一个硬件线程时为0，不测
+static unsigned int g_maxThreads = 0;
+
+static void runShape(Shape& shape)
+{
+    TreeCode tree;
+    tree.setMaxDepth(4096);
+    shape.build(tree,shape);
+
+    static const unsigned char FLAGS[] =
+    {
+        0,
+        TC_FLAG_VARINT,
+        TC_FLAG_SUBTREE_SIZE,
+        TC_FLAG_SUBTREE_SIZE | TC_FLAG_VARINT,
+        TC_FLAG_NAME_TABLE | TC_FLAG_VARINT,
+    };
+    for (size_t i=0;i<sizeof(FLAGS);i++)
+    {
+        unsigned char flags = FLAGS[i];
+        //先编码一次，按名称过滤掉encode时解码项仍然有数据
+        EncodeBench enc(tree,flags);
+        enc();
+        measure(shape,"encode",flags,enc.out.size(),enc);
+
+        DecodeBench dec(enc.out,false);
+        measure(shape,"decode",flags,enc.out.size(),dec);
+        DecodeBench decArena(enc.out,true);
+        measure(shape,"decode_arena",flags,enc.out.size(),decArena);
+
+        if (flags & TC_FLAG_NAME_TABLE)
+            continue;
+        ParserBench parse(enc.out);
+        measure(shape,"parser",flags,enc.out.size(),parse);
+        StreamDecodeBench stream(enc.out);
+        measure(shape,"decode_stream",flags,enc.out.size(),stream);
+        if (shape.viewable)
+        {
+            ViewFindBench view(enc.out,shape);
+            measure(shape,"view_find",flags,0,view,1);
+        }
+        if (flags & TC_FLAG_SUBTREE_SIZE)
+        {
+            for (unsigned int t=1;t<=g_maxThreads;t++)
+            {
+                char op[32];
+                snprintf(op,sizeof(op),"decode_parallel/t%u",t);
+                ParallelDecodeBench par(enc.out,t);
+                measure(shape,op,flags,enc.out.size(),par);
+            }
+        }
+    }
+
+    unsigned char packFlags = TC_FLAG_COMPRESSED | TC_FLAG_VARINT;
+    CompressBench pack(tree,packFlags);
+    pack();
+    measure(shape,"encode",packFlags,pack.out.size(),pack);
+    DecodeBench unpack(pack.out,true);
+    measure(shape,"decode_arena",packFlags,pack.out.size(),unpack);
+
+    tree.enableEncodeCache();
+    CachedEncodeBench cached(tree,TC_FLAG_SUBTREE_SIZE | TC_FLAG_VARINT,shape);
+    measure(shape,"encode_cached",cached.flags,tree.encodedSize(cached.flags),cached);
+    tree.enableEncodeCache(false);
+
+    FindBench find(tree,shape);
+    measure(shape,"find",0,0,find,1);
+    ReadSonBench readSon(tree,shape);
+    measure(shape,"read_son",0,0,readSon,1);
+    //打印按输出的长度计算mb_s
+    PrintBench print(tree,false);
+    print();
+    measure(shape,"print",0,print.out.size(),print);
+    RefPrintBench refPrint(tree);
+    refPrint();
+    measure(shape,"print_recursive",0,refPrint.out.size(),refPrint);
+    PrintBench json(tree,true);
+    json();
+    measure(shape,"json",0,json.out.size(),json);
+}
+
+int main(int argc,char* argv[])
+{
+    if (argc > 1 && argv[1][0] != '\0')
+        g_filter = argv[1];
+    if (argc > 2)
+        g_minNs = atof(argv[2]) * 1e6;
+    g_maxThreads = boost::thread::hardware_concurrency();
+    if (g_maxThreads <= 1)
+    {
+        g_maxThreads = 0;
+        fprintf(stderr,"only one hardware thread, decode_parallel/tN skipped\n");
+    }
+
+    Shape shapes[] =
+    {
+        {"wide",buildWide,Node::Double,true},
+        {"deep",buildDeep,Node::Int32,false},
+        {"strings",buildStrings,Node::UTF8String,true},
+        {"buffers",buildBuffers,Node::Buffer,true},
+        {"numeric",buildNumeric,Node::Double,true},
+    };
+    for (size_t i=0;i<sizeof(shapes) / sizeof(shapes[0]);i++)
+        runShape(shapes[i]);
+    return 0;
+}
@@ -0,0 +1,217 @@
+#ifndef _TREE_CODE_BINDING_H__
+#define _TREE_CODE_BINDING_H__
+
+#include "TreeCodeWriter.h"
+#include "TreeCodeView.h"
+
+/*结构体与TreeCode格式之间的直接编解码，不经过Node树
+  字段只需声明一次，节点类型按成员类型推导，规则与setObj/read相同；
+  成员本身是已绑定的结构体时编码为带子节点的空节点。
+
+  struct Player { int id; string nick; float3 pos; };
+  TREECODE_BIND(Player)
+      TREECODE_FIELD(id)
+      TREECODE_FIELD_NAMED("name",nick)
+      TREECODE_FIELD(pos)
+  TREECODE_BIND_END()
+
+  TreeCodeWriter w; encodeStruct(w,"player",player);
+  decodeStruct(data,len,player);
+  */
+template<typename T>
+    struct TreeCodeBinding
+    {
+        enum { BOUND = 0 };
+    };
+
+#define TREECODE_BIND(TYPE) \
+    template<> struct TreeCodeBinding<TYPE> \
+    { \
+        enum { BOUND = 1 }; \
+        template<typename V,typename O> static void visit(V& v,O& obj) \
+        {
+#define TREECODE_FIELD_NAMED(NAME,MEMBER) v.field(NAME,obj.MEMBER);
+#define TREECODE_FIELD(MEMBER) TREECODE_FIELD_NAMED(#MEMBER,MEMBER)
+#define TREECODE_BIND_END() \
+        } \
+    };
+
+template<bool B>
+    struct BindingTag
+    {
+    };
+
+//按声明顺序把字段写入TreeCodeWriter
+class BindingEncoder
+{
+    public:
+        explicit BindingEncoder(TreeCodeWriter& writer):writer(writer)
+        {
+
+        }
+
+        template<typename M>
+            void field(const char* name,const M& m)
+            {
+                put(name,m,BindingTag<TreeCodeBinding<M>::BOUND != 0>());
+            }
+
+    private:
+        template<typename M>
+            void put(const char* name,const M& m,BindingTag<false>)
+            {
+                writer.value(name,m);
+            }
+
+        template<typename M>
+            void put(const char* name,const M& m,BindingTag<true>)
+            {
+                writer.beginNode(name);
+                BindingEncoder sub(writer);
+                TreeCodeBinding<M>::visit(sub,m);
+                writer.endNode();
+            }
+
+        TreeCodeWriter& writer;
+};
+
+/*从一个节点的子节点中读出字段
+  子节点顺序和字段声明顺序一致时每个字段只比较一次名称，否则退回到按名称查找
+  */
+class BindingDecoder
+{
+    public:
+        BindingDecoder(const WireReader& reader,const WireNode& node,unsigned char flags)
+            :reader(reader),flags(flags),sons(node.sons),sonNum(node.sonNum),next(node.sons),index(0),good(true),missing(0)
+        {
+
+        }
+
+        template<typename M>
+            void field(const char* name,M& m)
+            {
+                if (!good)
+                    return;
+                size_t nameLen = strlen(name);
+                WireReader r = reader;
+                WireNode n;
+
+                //顺序匹配
+                if (index < sonNum && r.seek(next) && n.parse(r,flags) && n.name.equals(name,nameLen))
+                {
+                    if (!get(n,m,BindingTag<TreeCodeBinding<M>::BOUND != 0>()))
+                        missing++;
+                    if (!skipWireNodes(r,n.sonNum,flags))
+                    {
+                        good = false;
+                        return;
+                    }
+                    next = r.pos();
+                    index++;
+                    return;
+                }
+
+                //按名称查找
+                r = reader;
+                if (!r.seek(sons))
+                {
+                    good = false;
+                    return;
+                }
+                for (unsigned int i=0;i<sonNum;i++)
+                {
+                    if (!n.parse(r,flags))
+                    {
+                        good = false;
+                        return;
+                    }
+                    if (n.name.equals(name,nameLen))
+                    {
+                        if (!get(n,m,BindingTag<TreeCodeBinding<M>::BOUND != 0>()))
+                            missing++;
+                        return;
+                    }
+                    if (!skipWireNodes(r,n.sonNum,flags))
+                    {
+                        good = false;
+                        return;
+                    }
+                }
+                missing++;
+            }
+
+        //数据是否合法
+        bool ok() const
+        {
+            return good;
+        }
+
+        //没找到或类型不匹配的字段数
+        unsigned int missed() const
+        {
+            return missing;
+        }
+
+    private:
+        template<typename M>
+            bool get(const WireNode& n,M& m,BindingTag<false>)
+            {
+                return readWireValue(n.type,n.value,m);
+            }
+
+        template<typename M>
+            bool get(const WireNode& n,M& m,BindingTag<true>)
+            {
+                BindingDecoder sub(reader,n,flags);
+                TreeCodeBinding<M>::visit(sub,m);
+                if (!sub.ok())
+                    good = false;
+                missing += sub.missed();
+                return true;
+            }
+
+        WireReader reader;
+        unsigned char flags;
+        const unsigned char* sons;//第一个子节点
+        unsigned int sonNum;
+        const unsigned char* next;//下一个按顺序应该出现的子节点
+        unsigned int index;//next是第几个子节点
+        bool good;
+        unsigned int missing;
+};
+
+//把obj编码为名为name的节点
+template<typename T>
+    bool encodeStruct(TreeCodeWriter& writer,const string& name,const T& obj)
+    {
+        writer.beginNode(name);
+        BindingEncoder encoder(writer);
+        TreeCodeBinding<T>::visit(encoder,obj);
+        writer.endNode();
+        return writer.ok();
+    }
+
+/*从一条消息的根节点解码obj，自动识别v1和v2
+  数据不合法或有字段没找到、类型不匹配时返回false，能读到的字段仍然会写入obj
+  */
+template<typename T>
+    bool decodeStruct(const void* data,size_t len,T& obj)
+    {
+        unsigned char flags = 0;
+        WireReader reader(data,len);
+        if (readTreeCodeHeader(data,len,flags))
+        {
+            if (flags & ~TC_FLAG_RAW_MASK)
+                return false;
+            reader = WireReader((const char*)data + TREECODE_HEADER_SIZE,len - TREECODE_HEADER_SIZE);
+        }
+        WireReader r = reader;
+        WireNode root;
+        if (!root.parse(r,flags))
+            return false;
+        BindingDecoder decoder(reader,root,flags);
+        TreeCodeBinding<T>::visit(decoder,obj);
+        return decoder.ok() && decoder.missed() == 0;
+    }
+
+#endif
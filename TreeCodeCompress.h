@@ -0,0 +1,213 @@
+#ifndef _TREE_CODE_COMPRESS_H__
+#define _TREE_CODE_COMPRESS_H__
+
+#include <vector>
+#include "TreeCodeFormat.h"
+
+/*TreeCode消息的整体压缩，使用内置的LZ77类算法，不依赖外部库
+  压缩消息的格式：消息头(flags带TC_FLAG_COMPRESSED) + 4字节原始长度 + 压缩数据，
+  原始数据是去掉消息头后按其余flags编码的树
+  */
+
+#ifndef TREECODE_COMPRESS_MIN
+#define TREECODE_COMPRESS_MIN 1024 //编码后小于这个长度时不压缩
+#endif
+
+#ifndef TREECODE_MAX_UNPACK_LEN
+#define TREECODE_MAX_UNPACK_LEN (64u << 20) //解压后允许的最大长度，防止恶意数据
+#endif
+
+/*压缩数据由若干序列组成，每个序列：
+  1字节token(高4位字面量长度，低4位匹配长度-4，为15时后面跟扩展字节，每个255表示继续) +
+  字面量 + 2字节偏移(小端) + 匹配长度扩展字节；
+  最后一个序列只有字面量
+  */
+enum
+{
+    LZ_MIN_MATCH = 4,
+    LZ_HASH_BITS = 12,
+    LZ_MAX_OFFSET = 65535,
+    LZ_MAX_RATIO = 255,//每个输入字节最多还原出的字节数（匹配长度的扩展字节）
+};
+
+inline size_t lzCompressBound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+inline unsigned int lzRead32(const unsigned char* p)
+{
+    unsigned int v;
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
+inline unsigned int lzHash(unsigned int v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+inline unsigned char* lzWriteLength(unsigned char* op,size_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+//matchLen为0时是最后一个序列
+inline unsigned char* lzWriteSequence(unsigned char* op,const unsigned char* lit,size_t litLen,size_t offset,size_t matchLen)
+{
+    unsigned char* token = op++;
+    *token = (unsigned char)((litLen >= 15 ? 15 : litLen) << 4);
+    if (litLen >= 15)
+        op = lzWriteLength(op,litLen - 15);
+    memcpy(op,lit,litLen);
+    op += litLen;
+    if (matchLen == 0)
+        return op;
+
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+    size_t m = matchLen - LZ_MIN_MATCH;
+    *token |= (unsigned char)(m >= 15 ? 15 : m);
+    if (m >= 15)
+        op = lzWriteLength(op,m - 15);
+    return op;
+}
+
+//dst至少要有lzCompressBound(n)字节，返回压缩后的长度
+inline size_t lzCompress(const void* source,size_t n,void* dest)
+{
+    const unsigned char* src = (const unsigned char*)source;
+    unsigned char* op = (unsigned char*)dest;
+    unsigned int table[1 << LZ_HASH_BITS];//每个hash最近出现的位置
+    memset(table,0,sizeof(table));
+
+    size_t anchor = 0;//还没输出的字面量起点
+    size_t ip = 0;
+    while (n >= LZ_MIN_MATCH && ip <= n - LZ_MIN_MATCH)
+    {
+        unsigned int seq = lzRead32(src + ip);
+        unsigned int h = lzHash(seq);
+        size_t ref = table[h];
+        table[h] = (unsigned int)ip;
+        if (ref < ip && ip - ref <= LZ_MAX_OFFSET && lzRead32(src + ref) == seq)
+        {
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < n && src[ref + len] == src[ip + len])
+                len++;
+            op = lzWriteSequence(op,src + anchor,ip - anchor,ip - ref,len);
+            ip += len;
+            anchor = ip;
+        }
+        else
+        {
+            ip++;
+        }
+    }
+    op = lzWriteSequence(op,src + anchor,n - anchor,0,0);
+    return op - (unsigned char*)dest;
+}
+
+inline bool lzReadLength(const unsigned char*& ip,const unsigned char* end,size_t& len)
+{
+    unsigned char b;
+    do
+    {
+        if (ip >= end)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+//解压到dst，解压后的长度必须正好是rawLen；数据不合法时返回false，不会越界
+inline bool lzDecompress(const void* source,size_t n,void* dest,size_t rawLen)
+{
+    const unsigned char* ip = (const unsigned char*)source;
+    const unsigned char* end = ip + n;
+    unsigned char* dst = (unsigned char*)dest;
+    unsigned char* op = dst;
+    unsigned char* oend = dst + rawLen;
+    while (ip < end)
+    {
+        unsigned int token = *ip++;
+        size_t litLen = token >> 4;
+        if (litLen == 15 && !lzReadLength(ip,end,litLen))
+            return false;
+        if ((size_t)(end - ip) < litLen || (size_t)(oend - op) < litLen)
+            return false;
+        memcpy(op,ip,litLen);
+        op += litLen;
+        ip += litLen;
+        if (ip == end)
+            return op == oend;
+
+        if (end - ip < 2)
+            return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t matchLen = token & 15;
+        if (matchLen == 15 && !lzReadLength(ip,end,matchLen))
+            return false;
+        matchLen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(oend - op) < matchLen)
+            return false;
+        const unsigned char* ref = op - offset;
+        if (offset >= matchLen)
+        {
+            memcpy(op,ref,matchLen);
+            op += matchLen;
+        }
+        else
+        {
+            //重叠的匹配要逐字节复制
+            for (size_t i=0;i<matchLen;i++)
+                *op++ = *ref++;
+        }
+    }
+    return false;
+}
+
+/*压缩一棵已编码的树，body不含消息头，flags是body的编码方式
+  结果是完整的压缩消息，放在out中；压缩后没有变小时返回0
+  */
+inline size_t compressTreeCode(const void* body,size_t len,unsigned char flags,vector<char>& out)
+{
+    size_t head = TREECODE_HEADER_SIZE + sizeof(unsigned int);
+    out.resize(head + lzCompressBound(len));
+    RawWriter writer(&out[0]);
+    writeTreeCodeHeader(writer,flags | TC_FLAG_COMPRESSED);
+    unsigned int rawLen = len;
+    writer.write((const char*)&rawLen,sizeof(rawLen));
+    size_t packed = head + lzCompress(body,len,&out[0] + head);
+    size_t plain = len + ((flags != 0) ? TREECODE_HEADER_SIZE : 0);
+    return packed < plain ? packed : 0;
+}
+
+/*把压缩消息还原成普通的v2消息（消息头中去掉TC_FLAG_COMPRESSED），放在out中
+  out可以重复使用，避免每条消息都分配内存
+  */
+inline bool decompressTreeCode(const void* data,size_t len,vector<char>& out)
+{
+    unsigned char flags = 0;
+    size_t head = TREECODE_HEADER_SIZE + sizeof(unsigned int);
+    if (!readTreeCodeHeader(data,len,flags) || !(flags & TC_FLAG_COMPRESSED) || len < head)
+        return false;
+    unsigned int rawLen = 0;
+    memcpy(&rawLen,(const char*)data + TREECODE_HEADER_SIZE,sizeof(rawLen));
+    //原始长度不可能超过压缩数据能还原出的长度，先检查再分配，防止很短的消息要求大块内存
+    if (rawLen > TREECODE_MAX_UNPACK_LEN || rawLen > (uint64_t)(len - head) * LZ_MAX_RATIO)
+        return false;
+    out.resize(TREECODE_HEADER_SIZE + rawLen);
+    RawWriter writer(&out[0]);
+    writeTreeCodeHeader(writer,flags & ~TC_FLAG_COMPRESSED);
+    return lzDecompress((const char*)data + head,len - head,&out[0] + TREECODE_HEADER_SIZE,rawLen);
+}
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef _TREE_CODE_DECODER_H__
+#define _TREE_CODE_DECODER_H__
+
+#include "TreeCode.h"
+
+/*增量解码器：数据可以分任意多段送入，节点名称、字符串和buffer中途断开也没关系，
+  解码状态保存在解码器里，收到完整的树后feed返回DONE，结果在构造时传入的TreeCode中。
+  自动识别v1和v2(包括变长编码)，节点从TreeCode的arena分配，最大深度和buffer长度限制沿用TreeCode的设置，
+  字符串和数组的长度同样受buffer长度限制，分配内存前检查
+  */
+class TreeCodeDecoder
+{
+    public:
+        enum Status
+        {
+            FAILED = -1,//数据不合法，需要reset
+            NEED_MORE = 0,//还需要更多数据
+            DONE = 1,//树已完整
+        };
+
+        explicit TreeCodeDecoder(TreeCode& tree):tree(tree)
+        {
+            reset();
+        }
+
+        //开始解码一条新消息，TreeCode中原有的树会在收到第一个字节时清空
+        void reset()
+        {
+            state = S_START;
+            result = NEED_MORE;
+            flags = 0;
+            have = 0;
+            varValue = 0;
+            used = 0;
+            node = NULL;
+            stack.clear();
+        }
+
+        /*送入一段数据
+          DONE时data中可能还有属于下一条消息的数据，consumed()给出本次用掉的字节数
+          */
+        Status feed(const void* data,size_t len)
+        {
+            TREECODE_STAT_TIMER(TC_STAT_LOAD_NS);
+            const unsigned char* begin = (const unsigned char*)data;
+            const unsigned char* p = begin;
+            const unsigned char* end = begin + len;
+            Status before = result;
+            while (p < end && result == NEED_MORE)
+            {
+                step(p,end);
+            }
+            used = p - begin;
+            TREECODE_STAT_ADD(TC_STAT_BYTES_DECODED,used);
+            if (result != before)
+                TREECODE_STAT_ADD(result == DONE ? TC_STAT_LOADS : TC_STAT_LOAD_FAILURES,1);
+            return result;
+        }
+
+        Status status() const
+        {
+            return result;
+        }
+
+        //上一次feed用掉的字节数
+        size_t consumed() const
+        {
+            return used;
+        }
+
+    private:
+        enum State
+        {
+            S_START,//还没收到任何数据
+            S_HEADER,//收到0xFF，判断是不是v2消息头
+            S_TREE_SIZE,
+            S_NAME_LEN,
+            S_NAME,
+            S_TYPE,
+            S_VALUE,//定长内容或变长编码的整数
+            S_VALUE_LEN,//字符串或buffer的长度，数组的元素个数
+            S_VALUE_BYTES,//字符串、buffer或数组的内容
+            S_SON_NUM,
+        };
+
+        enum { SCRATCH_SIZE = 16 };
+
+        void step(const unsigned char*& p,const unsigned char* end)
+        {
+            switch (state)
+            {
+                case S_START:
+                    tree.reset();
+                    if (*p == TREECODE_MAGIC0)
+                    {
+                        state = S_HEADER;
+                    }
+                    else
+                    {
+                        beginNode(NULL);
+                    }
+                    break;
+                case S_HEADER:
+                    if (!fill(p,end,TREECODE_HEADER_SIZE))
+                        break;
+                    if (readTreeCodeHeader(scratch,TREECODE_HEADER_SIZE,flags))
+                    {
+                        if (flags & ~TC_FLAG_RAW_MASK)
+                        {
+                            ERROR_LOG("unsupported treecode flags[%u]",flags);
+                            result = FAILED;
+                            break;
+                        }
+                        beginNode(NULL);
+                    }
+                    else
+                    {
+                        //v1消息，根节点名称长度是255，已收到的后3个字节是名称的开头
+                        beginNode(NULL);
+                        node->name.resize(255);
+                        memcpy(&node->name[0],scratch + 1,TREECODE_HEADER_SIZE - 1);
+                        done = TREECODE_HEADER_SIZE - 1;
+                        state = S_NAME;
+                    }
+                    break;
+                case S_TREE_SIZE:
+                    if (fill(p,end,sizeof(node->treeSize)))
+                    {
+                        memcpy(&node->treeSize,scratch,sizeof(node->treeSize));
+                        state = S_NAME_LEN;
+                    }
+                    break;
+                case S_NAME_LEN:
+                    node->name.resize(*p++);
+                    done = 0;
+                    state = node->name.empty() ? S_TYPE : S_NAME;
+                    break;
+                case S_NAME:
+                    copy(p,end,&node->name[0],node->name.size());
+                    if (done == node->name.size())
+                        state = S_TYPE;
+                    break;
+                case S_TYPE:
+                    {
+                        pendingType = Node::isKnownType(*p) ? (Node::TypeCode)*p : Node::Empty;
+                        p++;
+                        int size = Node::valueSize(pendingType);
+                        if ((flags & TC_FLAG_VARINT) && Node::isVarintType(pendingType))
+                        {
+                            state = S_VALUE;
+                        }
+                        else if (size < 0)
+                        {
+                            state = S_VALUE_LEN;
+                        }
+                        else if (size > 0)
+                        {
+                            assert(size <= SCRATCH_SIZE);
+                            state = S_VALUE;
+                        }
+                        else
+                        {
+                            node->type = pendingType;
+                            state = S_SON_NUM;
+                        }
+                    }
+                    break;
+                case S_VALUE:
+                    if ((flags & TC_FLAG_VARINT) && Node::isVarintType(pendingType))
+                    {
+                        uint64_t v = 0;
+                        if (!fillVarint(p,end,v))
+                            break;
+                        Node::fromVarint(pendingType,v,&node->value);
+                        node->type = pendingType;
+                        state = S_SON_NUM;
+                    }
+                    else if (fill(p,end,Node::valueSize(pendingType)))
+                    {
+                        memcpy(&node->value,scratch,Node::valueSize(pendingType));
+                        node->type = pendingType;
+                        state = S_SON_NUM;
+                    }
+                    break;
+                case S_VALUE_LEN:
+                    if (flags & TC_FLAG_VARINT)
+                    {
+                        uint64_t v = 0;
+                        if (!fillVarint(p,end,v))
+                            break;
+                        if (v > 0xFFFFFFFFu)
+                        {
+                            result = FAILED;
+                            break;
+                        }
+                        beginBytes((unsigned int)v);
+                    }
+                    else if (fill(p,end,sizeof(unsigned int)))
+                    {
+                        unsigned int len = 0;
+                        memcpy(&len,scratch,sizeof(len));
+                        beginBytes(len);
+                    }
+                    break;
+                case S_VALUE_BYTES:
+                    copy(p,end,dst,dstLen);
+                    if (done == dstLen)
+                        state = S_SON_NUM;
+                    break;
+                case S_SON_NUM:
+                    if (flags & TC_FLAG_VARINT)
+                    {
+                        uint64_t v = 0;
+                        if (!fillVarint(p,end,v))
+                            break;
+                        if (v > 0xFFFF)
+                        {
+                            result = FAILED;
+                            break;
+                        }
+                        endNode((unsigned short)v);
+                    }
+                    else if (fill(p,end,sizeof(unsigned short)))
+                    {
+                        unsigned short num = 0;
+                        memcpy(&num,scratch,sizeof(num));
+                        endNode(num);
+                    }
+                    break;
+            }
+        }
+
+        //凑齐n个字节到scratch，凑齐时返回true
+        bool fill(const unsigned char*& p,const unsigned char* end,size_t n)
+        {
+            size_t m = n - have;
+            if ((size_t)(end - p) < m)
+                m = end - p;
+            memcpy(scratch + have,p,m);
+            p += m;
+            have += m;
+            if (have < n)
+                return false;
+            have = 0;
+            return true;
+        }
+
+        //逐字节累积一个变长整数，完整时返回true；have记录已收到的字节数，超过10字节时FAILED
+        bool fillVarint(const unsigned char*& p,const unsigned char* end,uint64_t& v)
+        {
+            while (p < end)
+            {
+                unsigned char b = *p++;
+                varValue |= (uint64_t)(b & 0x7F) << (7*have);
+                if (b < 0x80)
+                {
+                    v = varValue;
+                    varValue = 0;
+                    have = 0;
+                    return true;
+                }
+                if (++have == TREECODE_VARINT_MAX)
+                {
+                    result = FAILED;
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        //把数据拷到dst中还没填的部分
+        void copy(const unsigned char*& p,const unsigned char* end,void* dst,size_t n)
+        {
+            size_t m = n - done;
+            if ((size_t)(end - p) < m)
+                m = end - p;
+            memcpy((char*)dst + done,p,m);
+            p += m;
+            done += m;
+        }
+
+        //创建下一个节点，parent为NULL时是根节点
+        void beginNode(Node* parent)
+        {
+            if (parent == NULL)
+            {
+                node = Node::create(tree.arena);
+                tree.rootNode = tree.focusNode = node;
+            }
+            else
+            {
+                node = Node::create(parent->arena);
+                parent->sons.push_back(node);
+                node->parent = parent;
+            }
+            state = (flags & TC_FLAG_SUBTREE_SIZE) ? S_TREE_SIZE : S_NAME_LEN;
+        }
+
+        //长度已收到，准备接收字符串、buffer或数组的内容
+        void beginBytes(unsigned int len)
+        {
+            done = 0;
+            dstLen = len;
+            if (Node::isArrayType(pendingType))
+            {
+                uint64_t bytes = (uint64_t)len * Node::elemSize(pendingType);
+                if (bytes > tree.maxBufferLen)
+                {
+                    ERROR_LOG("array len > MAX_BUFF(%u),count is [%u]",tree.maxBufferLen,len);
+                    result = FAILED;
+                    return;
+                }
+                node->type = pendingType;
+                node->storeArray(NULL,len);
+                dst = node->as<Node::ArrayValue>().p;
+                dstLen = bytes;
+            }
+            else if (pendingType == Node::UTF8String)
+            {
+                //字符串在收到内容前就要分配，长度同样不能超过maxBufferLen
+                if (len > tree.maxBufferLen)
+                {
+                    ERROR_LOG("string len > MAX_BUFF(%u),len is [%u]",tree.maxBufferLen,len);
+                    result = FAILED;
+                    return;
+                }
+                Node::NodeString* s = new(&node->value) Node::NodeString(Node::NodeString::allocator_type(node->arena));
+                s->resize(len);
+                dst = len > 0 ? &(*s)[0] : NULL;
+            }
+            else
+            {
+                if (len > tree.maxBufferLen)
+                {
+                    ERROR_LOG("buffer len > MAX_BUFF(%u),len is [%u]",tree.maxBufferLen,len);
+                    result = FAILED;
+                    return;
+                }
+                node->storeBuffer(NULL,len);
+                dst = node->as<buffer_t>().p;
+            }
+            node->type = pendingType;
+            state = dstLen > 0 ? S_VALUE_BYTES : S_SON_NUM;
+        }
+
+        //当前节点读完，转到下一个节点
+        void endNode(unsigned short num)
+        {
+            if (num > 0)
+            {
+                if (stack.size() >= tree.maxDepth)
+                {
+                    ERROR_LOG("treecode too deep, max depth[%u]",tree.maxDepth);
+                    result = FAILED;
+                    return;
+                }
+                node->sons.reserve(num);
+                stack.push_back(Node::Frame(node,num));
+            }
+            while (!stack.empty() && stack.back().next == 0)
+                stack.pop_back();
+            if (stack.empty())
+            {
+                node = NULL;
+                result = DONE;
+                return;
+            }
+            stack.back().next--;
+            beginNode(stack.back().node);
+        }
+
+        TreeCode& tree;
+        State state;
+        Status result;
+        unsigned char flags;
+        Node* node;//正在解码的节点
+        Node::TypeCode pendingType;//已读到但内容还没读完的类型
+        Node::WorkStack stack;//祖先节点以及各自还没读取的子节点数量
+        unsigned char scratch[SCRATCH_SIZE];//凑齐定长字段
+        size_t have;//scratch中已有的字节
+        uint64_t varValue;//正在接收的变长整数
+        void* dst;//字符串或buffer内容的目标
+        size_t dstLen;
+        size_t done;//名称或内容已拷贝的字节
+        size_t used;
+};
+
+#endif
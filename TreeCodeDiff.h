@@ -0,0 +1,397 @@
+#ifndef _TREE_CODE_DIFF_H__
+#define _TREE_CODE_DIFF_H__
+
+#include "TreeCode.h"
+
+/*两棵树之间的差异，用于只同步变化的部分
+  补丁本身也是一棵TreeCode，可以按任意flags编码发送。根节点"patch"的每个子节点是一个操作，按顺序执行；
+  操作节点的内容是目标节点的路径(Int32Array，从根开始每层的子节点序号，空表示根)：
+    set  第一个子节点的名称和内容写入目标节点
+    add  所有子节点(子树)依次添加到目标节点末尾
+    del  第一个子节点(Int32Array)是要删除的子节点序号，从小到大
+    ord  第一个子节点(Int32Array)按新顺序给出每个子节点原来的序号，-1表示新节点，
+         新节点的子树依次是操作节点后面的子节点
+    clr  清空整棵树
+  路径中的序号都是执行到这个操作时的序号，一个节点的子节点变化总是在其子孙的操作之前
+
+    TreeCodeDiff d; TreeCode patch;
+    d.diff(last,now,patch); patch.out(st,TC_FLAG_VARINT);
+    ...
+    patch.load(data,len); d.apply(client,patch);
+  */
+class TreeCodeDiff
+{
+    public:
+        /*生成把oldTree变成newTree的补丁，patch原有内容被清空，返回操作个数（0表示两棵树相同）
+          同一个节点的子节点按名称对应：新旧列表中同名的第k个互相对应，对应上的继续比较，其余的删除或整棵添加
+          */
+        unsigned int diff(TreeCode& oldTree,TreeCode& newTree,TreeCode& patch)
+        {
+            patch.reset();
+            patch.addEmptyNode("patch");
+            ops = 0;
+            path.clear();
+            Node* o = oldTree.rootNode;
+            Node* n = newTree.rootNode;
+            if (n == NULL)
+            {
+                if (o != NULL)
+                    addOp(patch,"clr");
+                return ops;
+            }
+            if (o == NULL)
+            {
+                addSet(patch,n);
+                if (!n->sons.empty())
+                    addSons(patch,addOp(patch,"add"),n,0,n->sons.size());
+                return ops;
+            }
+
+            frames.clear();
+            maps.clear();
+            visit(patch,o,n);
+            while (!frames.empty())
+            {
+                Frame& f = frames.back();
+                if (f.next == f.n->sons.size())
+                {
+                    maps.resize(f.mapBegin);
+                    frames.pop_back();
+                    if (!frames.empty())
+                        path.pop_back();
+                    continue;
+                }
+                unsigned int k = f.next++;
+                int m = maps[f.mapBegin + k];
+                if (m < 0)
+                    continue;
+                Node* oc = f.o->sons[m];
+                Node* nc = f.n->sons[k];
+                path.push_back(k);
+                if (!visit(patch,oc,nc))
+                    path.pop_back();
+            }
+            return ops;
+        }
+
+        /*按顺序执行补丁中的操作，当前节点回到根节点
+          每个操作执行前先检查，不合法的操作不会修改树；但前面的操作已经生效，失败后应重新同步整棵树
+          */
+        bool apply(TreeCode& tree,TreeCode& patch)
+        {
+            Node* root = patch.rootNode;
+            if (root == NULL)
+                return false;
+            bool ok = true;
+            for (unsigned int i=0;i<root->sons.size();i++)
+            {
+                if (!applyOp(tree,root->sons[i]))
+                {
+                    ERROR_LOG("treecode patch op[%u] failed",i);
+                    ok = false;
+                    break;
+                }
+            }
+            tree.focusNode = tree.rootNode;
+            return ok;
+        }
+
+    private:
+        //一对互相对应的节点，map是新节点的每个子节点对应的旧子节点序号，放在maps中
+        struct Frame
+        {
+            Node* o;
+            Node* n;
+            unsigned int next;
+            size_t mapBegin;
+            Frame(Node* o,Node* n,size_t mapBegin):o(o),n(n),next(0),mapBegin(mapBegin) {}
+        };
+        typedef boost::unordered_map<TreeSlice,int,Node::SliceHash,Node::SliceEqual> NameMap;
+
+        //比较一对节点，生成它自身和子节点列表的操作；有子节点要继续比较时压栈并返回true
+        bool visit(TreeCode& patch,Node* o,Node* n)
+        {
+            if (o->name != n->name || !o->sameValue(*n))
+                addSet(patch,n);
+            if (o->sons.empty() && n->sons.empty())
+                return false;
+            size_t begin = maps.size();
+            matchSons(o,n,begin);
+            addStructure(patch,o,n,begin);
+            frames.push_back(Frame(o,n,begin));
+            return true;
+        }
+
+        //新旧子节点按名称对应，结果追加到maps
+        void matchSons(Node* o,Node* n,size_t begin)
+        {
+            unsigned int no = o->sons.size();
+            unsigned int nn = n->sons.size();
+            maps.resize(begin + nn);
+            if (no == nn)
+            {
+                //最常见的情况：名称逐个相同
+                unsigned int i = 0;
+                for (;i<nn && o->sons[i]->name == n->sons[i]->name;i++)
+                    maps[begin + i] = i;
+                if (i == nn)
+                    return;
+            }
+
+            //firstSame是每个名称还没对应的第一个旧子节点，nextSame是下一个同名的旧子节点
+            firstSame.clear();
+            nextSame.resize(no);
+            for (int i=(int)no - 1;i>=0;i--)
+            {
+                const Node::NodeString& s = o->sons[i]->name;
+                pair<NameMap::iterator,bool> r = firstSame.insert(make_pair(TreeSlice(s.data(),s.size()),i));
+                nextSame[i] = r.second ? -1 : r.first->second;
+                r.first->second = i;
+            }
+            for (unsigned int k=0;k<nn;k++)
+            {
+                const Node::NodeString& s = n->sons[k]->name;
+                NameMap::iterator it = firstSame.find(TreeSlice(s.data(),s.size()));
+                if (it == firstSame.end() || it->second < 0)
+                {
+                    maps[begin + k] = -1;
+                    continue;
+                }
+                maps[begin + k] = it->second;
+                it->second = nextSame[it->second];
+            }
+        }
+
+        //子节点列表变化时生成add、del或ord中最短的一个
+        void addStructure(TreeCode& patch,Node* o,Node* n,size_t begin)
+        {
+            unsigned int no = o->sons.size();
+            unsigned int nn = n->sons.size();
+            const int* m = (nn > 0) ? &maps[begin] : NULL;
+
+            //旧子节点都在原位：只有末尾添加或删除
+            unsigned int common = (no < nn) ? no : nn;
+            unsigned int k = 0;
+            while (k < common && m[k] == (int)k)
+                k++;
+            if (k == common)
+            {
+                if (nn > no)
+                    addSons(patch,addOp(patch,"add"),n,no,nn);
+                else if (no > nn)
+                {
+                    removed.clear();
+                    for (unsigned int i=nn;i<no;i++)
+                        removed.push_back(i);
+                    addIndexes(patch,addOp(patch,"del"),removed);
+                }
+                return;
+            }
+
+            //顺序不变且没有新节点：只有删除
+            int last = -1;
+            for (k=0;k<nn && m[k] > last;k++)
+                last = m[k];
+            if (k == nn)
+            {
+                removed.clear();
+                unsigned int j = 0;
+                for (unsigned int i=0;i<no;i++)
+                {
+                    if (j < nn && m[j] == (int)i)
+                        j++;
+                    else
+                        removed.push_back(i);
+                }
+                addIndexes(patch,addOp(patch,"del"),removed);
+                return;
+            }
+
+            Node* op = addOp(patch,"ord");
+            removed.assign(m,m + nn);
+            addIndexes(patch,op,removed);
+            for (k=0;k<nn;k++)
+            {
+                if (m[k] < 0)
+                    op->addSon(Node::clone(n->sons[k],patch.arena,cloneStack));
+            }
+        }
+
+        //在补丁末尾添加一个以当前路径为目标的操作
+        Node* addOp(TreeCode& patch,const char* name)
+        {
+            Node* op = Node::create(patch.arena);
+            op->name.assign(name);
+            op->setObj(TreeSpan<int>(path.empty() ? NULL : &path[0],path.size()));
+            patch.rootNode->addSon(op);
+            ops++;
+            return op;
+        }
+
+        void addSet(TreeCode& patch,const Node* n)
+        {
+            Node* op = addOp(patch,"set");
+            Node* v = Node::create(patch.arena);
+            v->name.assign(n->name.data(),n->name.size());
+            v->copyValue(*n);
+            op->addSon(v);
+        }
+
+        //把n的第begin到end-1个子树复制到op下
+        void addSons(TreeCode& patch,Node* op,const Node* n,unsigned int begin,unsigned int end)
+        {
+            for (unsigned int i=begin;i<end;i++)
+                op->addSon(Node::clone(n->sons[i],patch.arena,cloneStack));
+        }
+
+        void addIndexes(TreeCode& patch,Node* op,const vector<int>& indexes)
+        {
+            Node* v = Node::create(patch.arena);
+            v->name.assign("i");
+            v->setObj(indexes);
+            op->addSon(v);
+        }
+
+        bool applyOp(TreeCode& tree,const Node* op)
+        {
+            const Node::NodeString& name = op->name;
+            if (name == "clr")
+            {
+                tree.reset();
+                return true;
+            }
+            TreeSpan<int> p;
+            if (!op->get(p))
+                return false;
+            if (name == "set" && p.empty() && tree.rootNode == NULL)
+                tree.rootNode = tree.focusNode = Node::create(tree.arena);
+            Node* target = tree.rootNode;
+            if (target == NULL)
+                return false;
+            for (unsigned int i=0;i<p.size();i++)
+            {
+                if (p[i] < 0 || p[i] >= (int)target->sons.size())
+                    return false;
+                target = target->sons[p[i]];
+            }
+
+            if (name == "set")
+            {
+                if (op->sons.size() != 1)
+                    return false;
+                const Node* v = op->sons[0];
+                if (target->name != v->name)
+                {
+                    target->name.assign(v->name.data(),v->name.size());
+                    if (target->parent != NULL)
+                        resetSons(target->parent);
+                }
+                target->copyValue(*v);
+                return true;
+            }
+            if (name == "add")
+            {
+                for (unsigned int i=0;i<op->sons.size();i++)
+                    target->addSon(Node::clone(op->sons[i],tree.arena,cloneStack));
+                return true;
+            }
+            if (name != "del" && name != "ord")
+                return false;
+            TreeSpan<int> m;
+            if (op->sons.empty() || !op->sons[0]->get(m))
+                return false;
+            if (name == "del")
+                return removeSons(target,m);
+            return reorderSons(tree,target,m,op);
+        }
+
+        bool removeSons(Node* target,const TreeSpan<int>& indexes)
+        {
+            unsigned int no = target->sons.size();
+            int last = -1;
+            for (unsigned int i=0;i<indexes.size();i++)
+            {
+                if (indexes[i] <= last || indexes[i] >= (int)no)
+                    return false;
+                last = indexes[i];
+            }
+            Node::NodeList sons(ArenaAllocator<Node*>(target->arena));
+            sons.reserve(no - indexes.size());
+            unsigned int j = 0;
+            for (unsigned int i=0;i<no;i++)
+            {
+                if (j < indexes.size() && indexes[j] == (int)i)
+                {
+                    Node::destroy(target->sons[i],destroyStack);
+                    j++;
+                }
+                else
+                    sons.push_back(target->sons[i]);
+            }
+            target->sons.swap(sons);
+            resetSons(target);
+            return true;
+        }
+
+        bool reorderSons(TreeCode& tree,Node* target,const TreeSpan<int>& m,const Node* op)
+        {
+            unsigned int no = target->sons.size();
+            used.assign(no,0);
+            unsigned int added = 0;
+            for (unsigned int k=0;k<m.size();k++)
+            {
+                if (m[k] == -1)
+                    added++;
+                else if (m[k] < 0 || m[k] >= (int)no || used[m[k]])
+                    return false;
+                else
+                    used[m[k]] = 1;
+            }
+            if (added != op->sons.size() - 1)
+                return false;
+
+            Node::NodeList sons(ArenaAllocator<Node*>(target->arena));
+            sons.reserve(m.size());
+            unsigned int next = 1;
+            for (unsigned int k=0;k<m.size();k++)
+            {
+                if (m[k] >= 0)
+                {
+                    sons.push_back(target->sons[m[k]]);
+                    continue;
+                }
+                Node* c = Node::clone(op->sons[next++],tree.arena,cloneStack);
+                c->parent = target;
+                sons.push_back(c);
+            }
+            for (unsigned int i=0;i<no;i++)
+            {
+                if (!used[i])
+                    Node::destroy(target->sons[i],destroyStack);
+            }
+            target->sons.swap(sons);
+            resetSons(target);
+            return true;
+        }
+
+        //子节点列表或子节点名称变化后：索引重新建立，编码缓存失效
+        void resetSons(Node* target)
+        {
+            delete target->index;
+            target->index = NULL;
+            target->markDirty();
+        }
+
+        unsigned int ops;
+        vector<int> path;//当前比较的节点在新树中的路径
+        vector<Frame> frames;
+        vector<int> maps;//每层的子节点对应关系，和frames一起增减
+        vector<int> removed;
+        NameMap firstSame;
+        vector<int> nextSame;
+        vector<unsigned char> used;
+        vector<pair<const Node*,Node*> > cloneStack;
+        vector<Node*> destroyStack;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef _TREE_CODE_FILE_H__
+#define _TREE_CODE_FILE_H__
+
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TreeCodeFormat.h"
+
+/*文件的内存映射，TreeCode::load/save使用，也可以单独使用：
+  映射期间可以直接在映射上建立TreeCodeView或TreeCodeBatch，不拷贝任何数据
+    TreeCodeMappedFile file;
+    if (file.open("snapshot.tc")) { TreeCodeView view(file.data(),file.size()); ... }
+  */
+class TreeCodeMappedFile
+{
+    public:
+        TreeCodeMappedFile():fd(-1),base(NULL),len(0)
+        {
+
+        }
+
+        ~TreeCodeMappedFile()
+        {
+            close();
+        }
+
+        //只读映射整个文件，空文件也返回true（data()为NULL）
+        bool open(const std::string& filename)
+        {
+            close();
+            fd = ::open(filename.c_str(),O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd,&st) != 0)
+            {
+                close();
+                return false;
+            }
+            len = st.st_size;
+            if (len == 0)
+                return true;
+            void* p = mmap(NULL,len,PROT_READ,MAP_PRIVATE,fd,0);
+            if (p == MAP_FAILED)
+            {
+                close();
+                return false;
+            }
+            base = (char*)p;
+            madvise(base,len,MADV_SEQUENTIAL);
+            return true;
+        }
+
+        /*创建（或清空）文件并预先分配size字节，可写映射整个文件
+          预先分配空间，避免写映射时因磁盘满收到SIGBUS
+          */
+        bool create(const std::string& filename,size_t size)
+        {
+            close();
+            fd = ::open(filename.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+            if (fd < 0)
+                return false;
+            int err = posix_fallocate(fd,0,size);
+            if (err == EINVAL || err == EOPNOTSUPP)
+                err = (ftruncate(fd,size) == 0) ? 0 : errno;
+            if (err != 0)
+            {
+                close();
+                return false;
+            }
+            len = size;
+            if (len == 0)
+                return true;
+            void* p = mmap(NULL,len,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+            if (p == MAP_FAILED)
+            {
+                close();
+                return false;
+            }
+            base = (char*)p;
+            return true;
+        }
+
+        //解除映射并关闭文件，都成功时返回true
+        bool close()
+        {
+            bool ok = true;
+            if (base != NULL)
+                ok = (munmap(base,len) == 0);
+            if (fd >= 0)
+                ok = (::close(fd) == 0) && ok;
+            fd = -1;
+            base = NULL;
+            len = 0;
+            return ok;
+        }
+
+        bool isOpen() const
+        {
+            return fd >= 0;
+        }
+
+        char* data() const
+        {
+            return base;
+        }
+
+        size_t size() const
+        {
+            return len;
+        }
+
+        TreeSlice slice() const
+        {
+            return TreeSlice(base,len);
+        }
+
+    private:
+        TreeCodeMappedFile(const TreeCodeMappedFile&);
+        TreeCodeMappedFile& operator=(const TreeCodeMappedFile&);
+
+        int fd;
+        char* base;
+        size_t len;
+};
+
+//直接写文件描述符，接口与Stream::write相同；长度事先不知道时使用（如压缩后的消息）
+class TreeCodeFileSink
+{
+    public:
+        TreeCodeFileSink():fd(-1),good(false)
+        {
+
+        }
+
+        ~TreeCodeFileSink()
+        {
+            close();
+        }
+
+        bool open(const std::string& filename)
+        {
+            close();
+            fd = ::open(filename.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+            good = (fd >= 0);
+            return good;
+        }
+
+        void write(const char* p,size_t n)
+        {
+            while (good && n > 0)
+            {
+                ssize_t w = ::write(fd,p,n);
+                if (w < 0 && errno == EINTR)
+                    continue;
+                if (w <= 0)
+                {
+                    good = false;
+                    break;
+                }
+                p += w;
+                n -= w;
+            }
+        }
+
+        //关闭文件，之前的写入和关闭都成功时返回true
+        bool close()
+        {
+            if (fd < 0)
+                return false;
+            bool ok = (::close(fd) == 0) && good;
+            fd = -1;
+            good = false;
+            return ok;
+        }
+
+    private:
+        TreeCodeFileSink(const TreeCodeFileSink&);
+        TreeCodeFileSink& operator=(const TreeCodeFileSink&);
+
+        int fd;
+        bool good;
+};
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef _TREE_CODE_FORMAT_H__
+#define _TREE_CODE_FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*扩展格式(v2)的消息头，共4字节：0xFF 'T' 版本号 flags
+  v1没有消息头，第一个字节就是根节点名称长度；
+  只有根节点名称长255、以'T'开头且第二个字符是\x02的v1消息才会被误认
+  */
+enum
+{
+    TREECODE_MAGIC0 = 0xFF,
+    TREECODE_MAGIC1 = 'T',
+    TREECODE_VERSION = 2,
+    TREECODE_HEADER_SIZE = 4,
+};
+
+//v2编码选项，写在消息头的flags字节
+enum
+{
+    TC_FLAG_SUBTREE_SIZE = 0x01,//每个节点前有4字节子树长度(不含长度字段本身)，读取时可以直接跳过兄弟节点
+    TC_FLAG_VARINT = 0x02,//Int32/UInt32/Int64/UInt64、字符串和buffer长度、子节点数量用变长编码，子树长度仍是4字节
+    TC_FLAG_COMPRESSED = 0x04,//消息头之后整体压缩，见TreeCodeCompress.h；只有TreeCode::load能直接读取
+    TC_FLAG_NAME_TABLE = 0x08,//消息头之后是去重的名称表，节点名称只写序号；只有TreeCode能编解码
+
+    TC_FLAG_RAW_MASK = TC_FLAG_SUBTREE_SIZE | TC_FLAG_VARINT,//不需要解压、可以直接在编码数据上读取的flags
+    TC_FLAG_MASK = TC_FLAG_RAW_MASK | TC_FLAG_COMPRESSED | TC_FLAG_NAME_TABLE,//当前版本能解码的全部flags
+
+    TREECODE_MAX_NAMES = 1 << 24,//名称表最多的名称数，防止不合法的数据
+};
+
+/*变长整数(LEB128)：每字节低7位是数据，最高位为1表示后面还有字节，低位在前；
+  有符号数先做zigzag变换，绝对值小的负数也只占很少字节
+  */
+enum { TREECODE_VARINT_MAX = 10 };//64位整数最多10字节
+
+inline uint64_t zigzagEncode(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+inline unsigned int varintSize(uint64_t v)
+{
+    unsigned int n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+//编码到buf，返回字节数
+inline unsigned int encodeVarint(uint64_t v,unsigned char* buf)
+{
+    unsigned int n = 0;
+    while (v >= 0x80)
+    {
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    return n;
+}
+
+template<typename S>
+    void writeVarint(S& stream,uint64_t v)
+    {
+        unsigned char buf[TREECODE_VARINT_MAX];
+        stream.write((char*)buf,encodeVarint(v,buf));
+    }
+
+template<typename S>
+    void writeTreeCodeHeader(S& stream,unsigned char flags)
+    {
+        unsigned char header[TREECODE_HEADER_SIZE] = {TREECODE_MAGIC0,TREECODE_MAGIC1,TREECODE_VERSION,flags};
+        stream.write((char*)header,sizeof(header));
+    }
+
+//data以v2消息头开始时返回true并取出flags
+inline bool readTreeCodeHeader(const void* data,size_t len,unsigned char& flags)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    if (len < TREECODE_HEADER_SIZE || p[0] != TREECODE_MAGIC0 || p[1] != TREECODE_MAGIC1 || p[2] != TREECODE_VERSION)
+        return false;
+    flags = p[3];
+    return true;
+}
+
+/*直接在原始字节上解析TreeCode编码时使用的工具
+  不拷贝数据，所有结果都指向调用者提供的内存
+  */
+
+//一段借用的内存，不拥有数据
+struct TreeSlice
+{
+    const unsigned char* data;
+    size_t len;
+
+    TreeSlice():data(NULL),len(0) {}
+    TreeSlice(const void* data,size_t len):data((const unsigned char*)data),len(len) {}
+
+    const char* c_str() const { return (const char*)data; }//注意：不以0结尾
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+
+    bool equals(const char* s,size_t n) const
+    {
+        return len == n && (n == 0 || memcmp(data,s,n) == 0);
+    }
+    bool operator==(const string& s) const { return equals(s.data(),s.size()); }
+    bool operator!=(const string& s) const { return !equals(s.data(),s.size()); }
+
+    string str() const { return string((const char*)data,len); }
+};
+
+//一段借用的连续元素，不拥有数据，用于读写数组节点
+template<typename T>
+    struct TreeSpan
+    {
+        const T* data;
+        unsigned int count;
+
+        TreeSpan():data(NULL),count(0) {}
+        TreeSpan(const T* data,unsigned int count):data(data),count(count) {}
+
+        unsigned int size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T& operator[](unsigned int i) const { return data[i]; }
+        const T* begin() const { return data; }
+        const T* end() const { return data + count; }
+    };
+
+//顺序写入一段预先分配好的连续内存，调用者保证空间足够；接口与Stream::write相同
+class RawWriter
+{
+    public:
+        explicit RawWriter(void* dst):begin((char*)dst),cur((char*)dst)
+        {
+
+        }
+
+        void write(const char* p,size_t n)
+        {
+            memcpy(cur,p,n);
+            cur += n;
+        }
+
+        size_t size() const { return cur - begin; }
+
+    private:
+        char* begin;
+        char* cur;
+};
+
+//追加写入vector，接口与Stream::write相同
+class VectorWriter
+{
+    public:
+        explicit VectorWriter(std::vector<char>& buff):buff(buff)
+        {
+
+        }
+
+        void write(const char* p,size_t n)
+        {
+            buff.insert(buff.end(),p,p + n);
+        }
+
+        size_t size() const { return buff.size(); }
+
+    private:
+        std::vector<char>& buff;
+};
+
+//带边界检查的只读游标，越界后ok()返回false且不再前进
+class WireReader
+{
+    public:
+        WireReader():begin(NULL),cur(NULL),end(NULL),good(true) {}
+        WireReader(const void* data,size_t len)
+            :begin((const unsigned char*)data),cur(begin),end(begin+len),good(true)
+        {
+
+        }
+
+        template<typename T>
+            bool read(T& v)
+            {
+                if (!need(sizeof(T)))
+                    return false;
+                memcpy(&v,cur,sizeof(T));
+                cur += sizeof(T);
+                return true;
+            }
+
+        //读一个变长整数，数据截断或超过10字节时失败
+        bool readVarint(uint64_t& v)
+        {
+            if (!good)
+                return false;
+            //单字节最常见，直接返回
+            if (cur < end && *cur < 0x80)
+            {
+                v = *cur++;
+                return true;
+            }
+            uint64_t result = 0;
+            const unsigned char* p = cur;
+            const unsigned char* last = (size_t)(end - p) > TREECODE_VARINT_MAX ? p + TREECODE_VARINT_MAX : end;
+            for (unsigned int shift = 0;p < last;shift += 7)
+            {
+                unsigned char b = *p++;
+                result |= (uint64_t)(b & 0x7F) << shift;
+                if (b < 0x80)
+                {
+                    cur = p;
+                    v = result;
+                    return true;
+                }
+            }
+            good = false;
+            return false;
+        }
+
+        bool readSlice(size_t n,TreeSlice& s)
+        {
+            if (!need(n))
+                return false;
+            s.data = cur;
+            s.len = n;
+            cur += n;
+            return true;
+        }
+
+        bool skip(size_t n)
+        {
+            if (!need(n))
+                return false;
+            cur += n;
+            return true;
+        }
+
+        //跳到[begin,end]内的某个位置
+        bool seek(const unsigned char* p)
+        {
+            if (p < begin || p > end)
+            {
+                good = false;
+                return false;
+            }
+            cur = p;
+            return true;
+        }
+
+        const unsigned char* pos() const { return cur; }
+        const unsigned char* data() const { return begin; }
+        size_t offset() const { return cur - begin; }
+        size_t left() const { return end - cur; }
+        bool ok() const { return good; }
+
+    private:
+        bool need(size_t n)
+        {
+            if (!good || (size_t)(end - cur) < n)
+            {
+                good = false;
+                return false;
+            }
+            return true;
+        }
+
+        const unsigned char* begin;
+        const unsigned char* cur;
+        const unsigned char* end;
+        bool good;
+};
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef _TREE_CODE_PARALLEL_H__
+#define _TREE_CODE_PARALLEL_H__
+
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include "TreeCodeView.h"
+
+/*多线程解码大树，结果与TreeCode::load完全相同，包括对不合法数据的检查
+  先在原始数据上扫描出兄弟子树的边界（带TC_FLAG_SUBTREE_SIZE时只读长度，否则只解析节点头），
+  把靠近根的少数节点直接解码并预留好子节点位置，剩下的子树按连续的兄弟分成若干段，
+  各线程从按大小排好序的任务列表中取任务解码，填入父节点预留的位置。
+  工作线程在setThreads时创建并一直保留，每条消息只需要唤醒，不再创建线程。
+  启用arena时每个线程使用TreeCode中自己的arena。
+  数据太小、线程数为1或带名称表时直接调用TreeCode::load
+  */
+class TreeCodeParallelLoader
+{
+    public:
+        enum
+        {
+            MIN_PARALLEL_SIZE = 64 * 1024,//小于这个长度的消息不值得并行
+            TASKS_PER_THREAD = 4,
+        };
+
+        //threads为0时使用硬件线程数
+        explicit TreeCodeParallelLoader(unsigned int threads = 0)
+            :threads(1),pool(NULL),job(NULL),jobFlags(0),generation(0),busy(0),stopping(false)
+        {
+            setThreads(threads);
+        }
+
+        ~TreeCodeParallelLoader()
+        {
+            stopWorkers();
+        }
+
+        //重新设置线程数，除调用load的线程外的threads-1个工作线程一直保留，到下次设置或析构时结束
+        void setThreads(unsigned int n)
+        {
+            stopWorkers();
+            threads = (n != 0) ? n : boost::thread::hardware_concurrency();
+            if (threads == 0)
+                threads = 1;
+            if (threads > 1)
+            {
+                pool = new boost::thread_group();
+                for (unsigned int i=1;i<threads;i++)
+                    pool->create_thread(boost::bind(&TreeCodeParallelLoader::workerLoop,this,i));
+            }
+        }
+
+        unsigned int getThreads() const
+        {
+            return threads;
+        }
+
+        //从一段内存中载入，原有的树会被清空；数据不合法或深度超过限制时返回false
+        bool load(TreeCode& tree,const void* data,size_t len)
+        {
+            TREECODE_STAT_TIMER(TC_STAT_LOAD_NS);
+            TREECODE_STAT_ADD(TC_STAT_BYTES_DECODED,len);
+            bool ret = loadData(tree,data,len);
+            TREECODE_STAT_ADD(ret ? TC_STAT_LOADS : TC_STAT_LOAD_FAILURES,1);
+            return ret;
+        }
+
+    private:
+        //load的实现，统计在load中；不值得并行时按TreeCode::load的方式解码
+        bool loadData(TreeCode& tree,const void* data,size_t len)
+        {
+            unsigned char flags = 0;
+            if (readTreeCodeHeader(data,len,flags) && (flags & TC_FLAG_COMPRESSED))
+            {
+                if (!decompressTreeCode(data,len,unpacked))
+                {
+                    ERROR_LOG("treecode decompress failed, len[%u]",(unsigned int)len);
+                    return tree.loadFailed();
+                }
+                data = &unpacked[0];
+                len = unpacked.size();
+                flags &= ~TC_FLAG_COMPRESSED;
+            }
+            if (threads <= 1 || len < MIN_PARALLEL_SIZE || (flags & ~TC_FLAG_RAW_MASK))
+                return tree.decode((void*)data,len);
+
+            WireReader r(data,len);
+            if (readTreeCodeHeader(data,len,flags))
+                r.skip(TREECODE_HEADER_SIZE);
+
+            tree.reset();
+            Node* root = Node::create(tree.arena);
+            tree.rootNode = tree.focusNode = root;
+            if (!split(tree,root,r,flags,len))
+                return tree.loadFailed();
+            run(tree,flags);
+            if (failed)
+                return tree.loadFailed();
+            return true;
+        }
+
+        //一段连续的兄弟子树，解码后放到parent->sons[first]开始的位置
+        struct Task
+        {
+            Node* parent;
+            unsigned int first;
+            unsigned int count;
+            const unsigned char* begin;
+            size_t len;
+            unsigned int depth;//这些子树根节点的深度
+
+            //按长度从大到小排序，大的任务先开始
+            bool operator<(const Task& o) const
+            {
+                return len > o.len;
+            }
+        };
+
+        //解码靠近根的节点并生成任务
+        bool split(TreeCode& tree,Node* root,WireReader& r,unsigned char flags,size_t total)
+        {
+            tasks.clear();
+            size_t target = threads * TASKS_PER_THREAD;
+            size_t limit = total / target;
+            if (!expand(tree,root,r,flags,0,limit))
+                return false;
+
+            //把过大的单棵子树继续拆开
+            while (tasks.size() < target)
+            {
+                size_t largest = tasks.size();
+                for (size_t i=0;i<tasks.size();i++)
+                {
+                    if (tasks[i].count == 1 && tasks[i].len > limit && (largest == tasks.size() || tasks[i].len > tasks[largest].len))
+                        largest = i;
+                }
+                if (largest == tasks.size())
+                    break;
+                Task t = tasks[largest];
+                tasks[largest] = tasks.back();
+                tasks.pop_back();
+
+                Node* n = Node::create(t.parent->arena);
+                t.parent->sons[t.first] = n;
+                n->parent = t.parent;
+                WireReader sub(t.begin,t.len);
+                if (!expand(tree,n,sub,flags,t.depth,limit))
+                    return false;
+            }
+            std::sort(tasks.begin(),tasks.end());
+            return true;
+        }
+
+        //解码n自身，预留子节点位置，并把子节点按大约limit字节一段生成任务
+        bool expand(TreeCode& tree,Node* n,WireReader& r,unsigned char flags,unsigned int depth,size_t limit)
+        {
+            WireNode w;
+            if (!w.parse(r,flags))
+                return false;
+            BinaryReader head((void*)w.begin,w.sons - w.begin,false);
+            Node::NameTable names;
+            unsigned short num = n->loadSelf(head,flags,names,tree.maxBufferLen);
+            if (num == 0)
+                return true;
+            //与Node::load相同：根节点不检查，深度为depth的节点有子节点时要求depth < maxDepth
+            if (depth > 0 && depth >= tree.maxDepth)
+            {
+                ERROR_LOG("treecode too deep, max depth[%u]",tree.maxDepth);
+                return false;
+            }
+            n->sons.resize(num,NULL);
+
+            Task t;
+            t.parent = n;
+            t.depth = depth + 1;
+            t.count = 0;
+            for (unsigned int i=0;i<num;i++)
+            {
+                const unsigned char* begin = r.pos();
+                if (!skipWireNodes(r,1,flags))
+                    return false;
+                size_t len = r.pos() - begin;
+                //大的子树单独成段，小的和相邻的合并
+                if (t.count > 0 && (len > limit || (size_t)(r.pos() - t.begin) > limit))
+                {
+                    tasks.push_back(t);
+                    t.count = 0;
+                }
+                if (t.count == 0)
+                {
+                    t.first = i;
+                    t.begin = begin;
+                }
+                t.count++;
+                t.len = r.pos() - t.begin;
+            }
+            tasks.push_back(t);
+            return true;
+        }
+
+        void run(TreeCode& tree,unsigned char flags)
+        {
+            next = 0;
+            failed = false;
+            if (tree.arena != NULL)
+            {
+                while (tree.workerArenas.size() < threads)
+                    tree.workerArenas.push_back(new TreeArena());
+            }
+            stacks.resize(threads);
+            scans.resize(threads);
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                job = &tree;
+                jobFlags = flags;
+                busy = threads - 1;
+                generation++;
+                wake.notify_all();
+            }
+            work(tree,flags,0);
+            boost::mutex::scoped_lock lock(mutex);
+            while (busy > 0)
+                idle.wait(lock);
+            job = NULL;
+        }
+
+        //工作线程：等待run发出新的一批任务，参与解码后通知run，直到stopWorkers
+        void workerLoop(unsigned int id)
+        {
+            unsigned long seen = 0;
+            while (true)
+            {
+                TreeCode* tree;
+                unsigned char flags;
+                {
+                    boost::mutex::scoped_lock lock(mutex);
+                    while (!stopping && generation == seen)
+                        wake.wait(lock);
+                    if (stopping)
+                        return;
+                    seen = generation;
+                    tree = job;
+                    flags = jobFlags;
+                }
+                work(*tree,flags,id);
+                boost::mutex::scoped_lock lock(mutex);
+                if (--busy == 0)
+                    idle.notify_one();
+            }
+        }
+
+        void stopWorkers()
+        {
+            if (pool == NULL)
+                return;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                stopping = true;
+                wake.notify_all();
+            }
+            pool->join_all();
+            delete pool;
+            pool = NULL;
+            stopping = false;
+            generation = 0;//新的工作线程从0开始等待
+        }
+
+        //线程id不断取下一个任务解码，直到没有任务或出错
+        void work(TreeCode& tree,unsigned char flags,unsigned int id)
+        {
+            TreeArena* arena = (tree.arena != NULL) ? tree.workerArenas[id] : NULL;
+            Node::WorkStack& stack = stacks[id];
+            while (true)
+            {
+                size_t i;
+                {
+                    boost::mutex::scoped_lock lock(mutex);
+                    if (failed || next >= tasks.size())
+                        return;
+                    i = next++;
+                }
+                const Task& t = tasks[i];
+                unsigned int maxDepth = (t.depth < tree.maxDepth) ? tree.maxDepth - t.depth : 0;
+                if (!check(t,flags,scans[id],maxDepth,tree.maxBufferLen))
+                {
+                    boost::mutex::scoped_lock lock(mutex);
+                    failed = true;
+                    return;
+                }
+                BinaryReader stream((void*)t.begin,t.len,false);
+                for (unsigned int k=0;k<t.count;k++)
+                {
+                    Node* n = Node::create(arena);
+                    t.parent->sons[t.first + k] = n;
+                    n->parent = t.parent;
+                    if (!n->load(stream,flags,stack,maxDepth,tree.maxBufferLen))
+                    {
+                        boost::mutex::scoped_lock lock(mutex);
+                        failed = true;
+                        return;
+                    }
+                }
+            }
+        }
+
+        /*与TreeCode::load的预先检查相同，在解码前确认任务中的子树都完整、长度不越界，
+          检查放在各线程中，不增加串行的部分
+          */
+        static bool check(const Task& t,unsigned char flags,Node::ScanBuffer& buff,unsigned int maxDepth,unsigned int maxBuffer)
+        {
+            WireReader r(t.begin,t.len);
+            Node::ScanResult info;
+            info.clear();
+            for (unsigned int k=0;k<t.count;k++)
+            {
+                if (!Node::scanTree(r,flags,buff,maxDepth,maxBuffer,info))
+                    return Node::scanFailed(r);
+            }
+            return r.left() == 0 || Node::scanFailed(r);
+        }
+
+        unsigned int threads;
+        vector<Task> tasks;
+        vector<Node::WorkStack> stacks;//每个线程一个
+        vector<Node::ScanBuffer> scans;//每个线程一个
+        vector<char> unpacked;//解压后的数据，重复使用
+        boost::thread_group* pool;//常驻的工作线程
+        boost::mutex mutex;//保护以下的调度状态
+        boost::condition_variable wake;//有新的任务或需要退出
+        boost::condition_variable idle;//工作线程完成了本批任务
+        TreeCode* job;//本批任务解码到的树
+        unsigned char jobFlags;
+        unsigned long generation;//每次run加1，工作线程据此判断是否有新的任务
+        unsigned int busy;//还没完成本批任务的工作线程数
+        bool stopping;
+        size_t next;
+        bool failed;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef _TREE_CODE_PARSER_H__
+#define _TREE_CODE_PARSER_H__
+
+#include "TreeCodeView.h"
+
+/*事件方式处理TreeCode数据的接口
+  name和value都指向源数据，需要时用readWireValue按类型读取
+  */
+class TreeCodeVisitor
+{
+    public:
+        enum Action
+        {
+            CONTINUE = 0,//继续
+            SKIP = 1,//跳过这个节点的子节点，只在onNodeBegin中有效
+            STOP = 2,//立即停止解析
+        };
+
+        virtual ~TreeCodeVisitor() {}
+
+        //遇到一个节点，子节点在onNodeBegin和onNodeEnd之间依次出现
+        virtual Action onNodeBegin(const TreeSlice& name,Node::TypeCode type,const TreeSlice& value) = 0;
+
+        //节点及其子节点都已处理完（包括被SKIP的节点）
+        virtual Action onNodeEnd()
+        {
+            return CONTINUE;
+        }
+};
+
+/*按编码格式顺序扫描一遍数据并回调visitor，不建树也不拷贝；
+  自动识别v1和v2，v2消息SKIP时可以直接跳过整棵子树。
+  内部的栈可以重复使用，多次解析不会再分配内存
+  */
+class TreeCodeParser
+{
+    public:
+        enum Result
+        {
+            PARSE_ERROR = -1,//数据不合法或太深
+            PARSE_STOPPED = 0,//visitor要求停止
+            PARSE_DONE = 1,//整棵树都已处理
+        };
+
+        explicit TreeCodeParser(unsigned int maxDepth = TREECODE_MAX_DEPTH):maxDepth(maxDepth)
+        {
+
+        }
+
+        Result parse(const void* data,size_t len,TreeCodeVisitor& visitor)
+        {
+            unsigned char flags = 0;
+            WireReader r(data,len);
+            if (readTreeCodeHeader(data,len,flags))
+            {
+                if (flags & ~TC_FLAG_RAW_MASK)
+                    return PARSE_ERROR;
+                r.skip(TREECODE_HEADER_SIZE);
+            }
+
+            stack.clear();
+            WireNode n;
+            while (true)
+            {
+                if (!n.parse(r,flags))
+                    return PARSE_ERROR;
+                TreeCodeVisitor::Action act = visitor.onNodeBegin(n.name,n.type,n.value);
+                if (act == TreeCodeVisitor::STOP)
+                    return PARSE_STOPPED;
+
+                unsigned short sonNum = n.sonNum;
+                if (act == TreeCodeVisitor::SKIP && sonNum > 0)
+                {
+                    if (!skipWireNodes(r,sonNum,flags))
+                        return PARSE_ERROR;
+                    sonNum = 0;
+                }
+                if (sonNum > 0)
+                {
+                    if (stack.size() >= maxDepth)
+                        return PARSE_ERROR;
+                    stack.push_back(sonNum);
+                    continue;
+                }
+
+                //节点结束，再逐层结束已经没有剩余子节点的祖先
+                if (visitor.onNodeEnd() == TreeCodeVisitor::STOP)
+                    return PARSE_STOPPED;
+                while (!stack.empty())
+                {
+                    if (--stack.back() > 0)
+                        break;
+                    stack.pop_back();
+                    if (visitor.onNodeEnd() == TreeCodeVisitor::STOP)
+                        return PARSE_STOPPED;
+                }
+                if (stack.empty())
+                    return PARSE_DONE;
+            }
+        }
+
+    private:
+        unsigned int maxDepth;
+        vector<unsigned short> stack;//每层还没处理的子节点数量
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef _TREE_CODE_STATS_H__
+#define _TREE_CODE_STATS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/*运行统计：编译时定义TREECODE_STATS后，解码、编码、查找等位置累加全进程的计数，
+  否则统计点都是空宏，没有任何开销。计数用原子操作，可以在多个线程中同时更新
+  导出到监控：
+    TreeCodeStatsSnapshot s = treeCodeStats();
+    for (int i=0;i<TC_STAT_COUNT;i++) report(treeCodeStatName(i),s[i]);
+  */
+enum TreeCodeStat
+{
+    TC_STAT_NODES_CREATED,//创建的节点数
+    TC_STAT_LOADS,//成功解码的消息数
+    TC_STAT_LOAD_FAILURES,//解码失败的消息数
+    TC_STAT_LOAD_NS,//解码用的时间（纳秒）
+    TC_STAT_BYTES_DECODED,//解码的输入字节数（压缩消息按压缩后的长度）
+    TC_STAT_ENCODES,//编码的消息数，包括保存到文件
+    TC_STAT_ENCODE_NS,//编码用的时间（纳秒）
+    TC_STAT_BYTES_ENCODED,//编码输出的字节数
+    TC_STAT_READ_MISMATCHES,//TreeCode::read类型不符
+    TC_STAT_LOOKUP_MISSES,//按名称找不到子节点
+    TC_STAT_COUNT,
+};
+
+inline const char* treeCodeStatName(int i)
+{
+    static const char* const names[TC_STAT_COUNT] =
+    {
+        "nodes_created",
+        "loads",
+        "load_failures",
+        "load_ns",
+        "bytes_decoded",
+        "encodes",
+        "encode_ns",
+        "bytes_encoded",
+        "read_mismatches",
+        "lookup_misses",
+    };
+    return (i >= 0 && i < TC_STAT_COUNT) ? names[i] : "";
+}
+
+//全进程的计数，静态初始化为0
+inline volatile uint64_t* treeCodeCounters()
+{
+    static volatile uint64_t counters[TC_STAT_COUNT];
+    return counters;
+}
+
+struct TreeCodeStatsSnapshot
+{
+    uint64_t values[TC_STAT_COUNT];
+
+    uint64_t operator[](int i) const
+    {
+        return values[i];
+    }
+};
+
+//是否编译了统计，没有时快照全部为0
+inline bool treeCodeStatsEnabled()
+{
+#ifdef TREECODE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+//当前计数的快照，每个计数单独原子读取
+inline TreeCodeStatsSnapshot treeCodeStats()
+{
+    TreeCodeStatsSnapshot s;
+    volatile uint64_t* c = treeCodeCounters();
+    for (int i=0;i<TC_STAT_COUNT;i++)
+        s.values[i] = __sync_fetch_and_add(&c[i],0);
+    return s;
+}
+
+inline void resetTreeCodeStats()
+{
+    volatile uint64_t* c = treeCodeCounters();
+    for (int i=0;i<TC_STAT_COUNT;i++)
+        __sync_fetch_and_and(&c[i],0);
+}
+
+#ifdef TREECODE_STATS
+
+inline void treeCodeStatAdd(int i,uint64_t n)
+{
+    __sync_fetch_and_add(&treeCodeCounters()[i],n);
+}
+
+//作用域结束时把经过的时间加到计数上
+class TreeCodeStatTimer
+{
+    public:
+        explicit TreeCodeStatTimer(int stat):stat(stat)
+        {
+            clock_gettime(CLOCK_MONOTONIC,&start);
+        }
+
+        ~TreeCodeStatTimer()
+        {
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC,&end);
+            int64_t ns = (int64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+            treeCodeStatAdd(stat,ns > 0 ? ns : 0);
+        }
+
+    private:
+        int stat;
+        struct timespec start;
+};
+
+//统计编码输出的字节数，转发给S
+template<typename S>
+class TreeCodeCountingWriter
+{
+    public:
+        explicit TreeCodeCountingWriter(S& st):st(st),n(0)
+        {
+
+        }
+
+        void write(const char* p,size_t len)
+        {
+            st.write(p,len);
+            n += len;
+        }
+
+        size_t size() const
+        {
+            return n;
+        }
+
+    private:
+        S& st;
+        size_t n;
+};
+
+#define TREECODE_STAT_ADD(stat,n) treeCodeStatAdd(stat,n)
+#define TREECODE_STAT_TIMER(stat) TreeCodeStatTimer treeCodeStatTimer(stat)
+
+#else
+
+#define TREECODE_STAT_ADD(stat,n) ((void)0)
+#define TREECODE_STAT_TIMER(stat) ((void)0)
+
+#endif
+
+#endif
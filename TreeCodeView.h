@@ -0,0 +1,383 @@
+#ifndef _TREE_CODE_VIEW_H__
+#define _TREE_CODE_VIEW_H__
+
+#include "TreeCode.h"
+#include "TreeCodeFormat.h"
+
+//从原始字节中解析出的节点头，所有指针都指向源数据
+struct WireNode
+{
+    const unsigned char* begin;//节点起始位置
+    TreeSlice name;
+    Node::TypeCode type;
+    TreeSlice value;//定长类型是内容本身，UTF8String、Buffer和数组是去掉长度后的内容；变长编码的整数指向number
+    unsigned short sonNum;
+    const unsigned char* sons;//第一个子节点的位置
+    const unsigned char* end;//子树结束位置，只有带TC_FLAG_SUBTREE_SIZE时已知，否则为NULL
+    uint64_t number;//TC_FLAG_VARINT时还原后的整数内容
+
+    WireNode():begin(NULL),type(Node::Empty),sonNum(0),sons(NULL),end(NULL),number(0) {}
+
+    WireNode(const WireNode& o)
+    {
+        *this = o;
+    }
+
+    WireNode& operator=(const WireNode& o)
+    {
+        begin = o.begin;
+        name = o.name;
+        type = o.type;
+        value = o.value;
+        sonNum = o.sonNum;
+        sons = o.sons;
+        end = o.end;
+        number = o.number;
+        if (o.value.data == (const unsigned char*)&o.number)
+            value.data = (const unsigned char*)&number;
+        return *this;
+    }
+
+    //解析r当前位置的节点头，成功后r停在第一个子节点处
+    bool parse(WireReader& r,unsigned char flags)
+    {
+        begin = r.pos();
+        end = NULL;
+        if (flags & TC_FLAG_SUBTREE_SIZE)
+        {
+            unsigned int treeSize = 0;
+            if (!r.read(treeSize) || r.left() < treeSize)
+                return false;
+            end = r.pos() + treeSize;
+        }
+
+        unsigned char nameLen = 0;
+        unsigned char intType = 0;
+        if (!r.read(nameLen) || !r.readSlice(nameLen,name) || !r.read(intType) || !Node::isKnownType(intType))
+            return false;
+        type = (Node::TypeCode)intType;
+
+        bool varint = (flags & TC_FLAG_VARINT) != 0;
+        int size = Node::valueSize(type);
+        if (varint && Node::isVarintType(type))
+        {
+            uint64_t v = 0;
+            if (!r.readVarint(v))
+                return false;
+            number = 0;
+            Node::fromVarint(type,v,&number);
+            value = TreeSlice(&number,size);
+        }
+        else if (size < 0)
+        {
+            unsigned int len = 0;
+            if (!readLength(r,varint,len))
+                return false;
+            uint64_t bytes = len;
+            if (Node::isArrayType(type))
+                bytes *= Node::elemSize(type);
+            if (bytes > r.left() || !r.readSlice((size_t)bytes,value))
+                return false;
+        }
+        else if (!r.readSlice(size,value))
+        {
+            return false;
+        }
+
+        if (varint)
+        {
+            uint64_t v = 0;
+            if (!r.readVarint(v) || v > 0xFFFF)
+                return false;
+            sonNum = (unsigned short)v;
+        }
+        else if (!r.read(sonNum))
+        {
+            return false;
+        }
+        sons = r.pos();
+        return true;
+    }
+
+    private:
+    static bool readLength(WireReader& r,bool varint,unsigned int& len)
+    {
+        if (!varint)
+            return r.read(len);
+        uint64_t v = 0;
+        if (!r.readVarint(v) || v > 0xFFFFFFFFu)
+            return false;
+        len = (unsigned int)v;
+        return true;
+    }
+};
+
+//跳过r当前位置开始的count棵完整子树，不递归；有子树长度时直接跳过
+inline bool skipWireNodes(WireReader& r,size_t count,unsigned char flags)
+{
+    if (flags & TC_FLAG_SUBTREE_SIZE)
+    {
+        for (size_t i=0;i<count;i++)
+        {
+            unsigned int treeSize = 0;
+            if (!r.read(treeSize) || !r.skip(treeSize))
+                return false;
+        }
+        return true;
+    }
+
+    WireNode n;
+    while (count > 0)
+    {
+        if (!n.parse(r,flags))
+            return false;
+        count += n.sonNum;
+        count--;
+    }
+    return true;
+}
+
+/*按类型读取原始字节中的节点内容，类型规则与Node::get相同
+  value是WireNode::value，UTF8String和Buffer可以读成TreeSlice而不拷贝
+  */
+#define WIRE_READ(T,E) inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,T& v) {if(type != E) return false; memcpy(&v,value.data,sizeof(T)); return true;}
+#define WIRE_READ2(T,E1,E2) inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,T& v) {if(type != E1 && type != E2) return false; memcpy(&v,value.data,sizeof(T)); return true;}
+WIRE_READ(bool,Node::Boolean)	WIRE_READ2(char,Node::SByte,Node::Byte)	WIRE_READ2(unsigned char,Node::Byte,Node::SByte)
+    WIRE_READ(short,Node::Int16)	WIRE_READ2(unsigned short,Node::UInt16,Node::WChar)	WIRE_READ(int,Node::Int32)
+    WIRE_READ(unsigned int,Node::UInt32)	WIRE_READ(int64_t,Node::Int64)	WIRE_READ(uint64_t,Node::UInt64)
+    WIRE_READ(float,Node::Single)	WIRE_READ(double,Node::Double)	WIRE_READ(float2,Node::Vector2)
+    WIRE_READ(float3,Node::Vector3)	WIRE_READ(pos2,Node::Pos2)
+
+//数组拷贝到vector；源数据不保证对齐，不提供直接指向源数据的TreeSpan
+#define WIRE_READ_ARRAY(T,E) inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,vector<T>& v) {if(type != E) return false; v.resize(value.len / sizeof(T)); if(!v.empty()) memcpy(&v[0],value.data,v.size() * sizeof(T)); return true;}
+WIRE_READ_ARRAY(int,Node::Int32Array)	WIRE_READ_ARRAY(int64_t,Node::Int64Array)	WIRE_READ_ARRAY(float,Node::SingleArray)
+    WIRE_READ_ARRAY(double,Node::DoubleArray)	WIRE_READ_ARRAY(float2,Node::Vector2Array)	WIRE_READ_ARRAY(float3,Node::Vector3Array)
+    WIRE_READ_ARRAY(pos2,Node::Pos2Array)
+
+inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,TreeSlice& v)
+{
+    if (type != Node::UTF8String && type != Node::Buffer)
+        return false;
+    v = value;
+    return true;
+}
+
+//Buffer读成TreeBuffer时拷贝一份；消息本身在TreeBuffer中时可以读成TreeSlice后用msg.slice共享，不拷贝
+inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,TreeBuffer& v)
+{
+    if (type != Node::Buffer)
+        return false;
+    v = TreeBuffer(value.data,value.len);
+    return true;
+}
+
+//会拷贝；Empty节点得到"null"
+inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,string& v)
+{
+    if (type == Node::Empty)
+    {
+        v = "null";
+        return true;
+    }
+    if (type != Node::UTF8String)
+        return false;
+    v.assign(value.c_str(),value.size());
+    return true;
+}
+
+//不支持的类型
+template<typename T>
+    inline bool readWireValue(Node::TypeCode type,const TreeSlice& value,T& v)
+    {
+        return false;
+    }
+
+/*TreeCode的只读视图，直接在调用者的内存上按编码格式导航，
+  名称、字符串和buffer都以TreeSlice返回，不拷贝也不做堆分配；
+  视图使用期间数据必须保持有效。
+  导航方式与TreeCode相同：getSon/findNode会移动当前节点，readSon不会。
+  v2消息带子树长度时查找子节点只需逐个跳过兄弟节点，只解码路径上的节点
+  */
+class TreeCodeView
+{
+    public:
+        enum { MAX_DEPTH = 64 };//可导航的最大深度
+
+        TreeCodeView():flags(0),depth(-1)
+        {
+
+        }
+
+        TreeCodeView(const void* data,UInt32 len):flags(0),depth(-1)
+        {
+            load(data,len);
+        }
+
+        //解析根节点，自动识别v1和v2，数据不合法时返回false
+        bool load(const void* data,UInt32 len)
+        {
+            flags = 0;
+            depth = -1;
+            if (readTreeCodeHeader(data,len,flags))
+            {
+                if (flags & ~TC_FLAG_RAW_MASK)
+                    return false;
+                reader = WireReader((const char*)data + TREECODE_HEADER_SIZE,len - TREECODE_HEADER_SIZE);
+            }
+            else
+                reader = WireReader(data,len);
+            WireReader r = reader;
+            if (!path[0].parse(r,flags))
+                return false;
+            depth = 0;
+            return true;
+        }
+
+        bool valid() const
+        {
+            return depth >= 0;
+        }
+
+        //得到当前节点
+        const WireNode* focus() const
+        {
+            return depth >= 0 ? &path[depth] : NULL;
+        }
+
+        //回到根节点
+        const WireNode* toRoot()
+        {
+            if (depth > 0)
+                depth = 0;
+            return focus();
+        }
+
+        //回到上层节点
+        const WireNode* toParent()
+        {
+            if (depth > 0)
+                depth--;
+            return focus();
+        }
+
+        //得到子节点数量
+        int getSonNum() const
+        {
+            return path[depth].sonNum;
+        }
+
+        //得到第i个子节点，需要跳过前面i棵子树
+        const WireNode* getSon(unsigned int i)
+        {
+            const WireNode& f = path[depth];
+            if (i >= f.sonNum || depth + 1 >= MAX_DEPTH)
+                return NULL;
+            WireReader r = reader;
+            if (!r.seek(f.sons) || !skipWireNodes(r,i,flags))
+                return NULL;
+            if (!path[depth + 1].parse(r,flags))
+                return NULL;
+            return &path[++depth];
+        }
+
+        //得到最后一个子节点
+        const WireNode* getLastSon()
+        {
+            if (path[depth].sonNum == 0)
+                return NULL;
+            return getSon(path[depth].sonNum - 1);
+        }
+
+        /*按名称得到子节点
+          \boolAssert 找不到时是否assert
+          */
+        const WireNode* getSon(const char* name,size_t nameLen,bool boolAssert=false)
+        {
+            const WireNode& f = path[depth];
+            if (depth + 1 >= MAX_DEPTH)
+                return NULL;
+            WireReader r = reader;
+            if (!r.seek(f.sons))
+                return NULL;
+            WireNode& n = path[depth + 1];
+            for (unsigned int i=0;i<f.sonNum;i++)
+            {
+                if (!n.parse(r,flags))
+                    break;
+                if (n.name.equals(name,nameLen))
+                    return &path[++depth];
+                if (n.end != NULL ? !r.seek(n.end) : !skipWireNodes(r,n.sonNum,flags))
+                    break;
+            }
+            if (boolAssert)
+                assert(!"can't find node");
+            return NULL;
+        }
+
+        const WireNode* getSon(const string& name,bool boolAssert=false)
+        {
+            return getSon(name.data(),name.size(),boolAssert);
+        }
+
+        /*通过路径名得到子节点，以'/'开头时从根节点开始
+          \boolAssert 找不到时是否assert
+          */
+        const WireNode* findNode(const string& name,bool boolAssert=false)
+        {
+            const char* p = name.data();
+            const char* end = p + name.size();
+            if (p != end && *p == '/')
+                depth = 0;
+            while (p != end)
+            {
+                if (*p == '/')
+                {
+                    p++;
+                    continue;
+                }
+                const char* seg = p;
+                while (p != end && *p != '/')
+                    p++;
+                if (getSon(seg,p - seg,boolAssert) == NULL)
+                    return NULL;
+            }
+            return focus();
+        }
+
+        //尝试读取一个子节点的内容并不改变当前节点
+        template<typename T>
+            bool readSon(const string& sonname,T& t)
+            {
+                if (getSon(sonname,false) == NULL)
+                    return false;
+                bool ret = read(t);
+                toParent();
+                return ret;
+            }
+
+        //读取当前节点的值，规则见readWireValue；UTF8String和Buffer读成TreeSlice时不拷贝
+        template<typename T>
+            bool read(T& v) const
+            {
+                return readWireValue(path[depth].type,path[depth].value,v);
+            }
+
+        //得到当前节点的名称
+        TreeSlice getName() const
+        {
+            return path[depth].name;
+        }
+
+        Node::TypeCode getType() const
+        {
+            return path[depth].type;
+        }
+
+    private:
+        WireReader reader;//整段数据，不含消息头
+        unsigned char flags;//消息头中的flags，v1为0
+        WireNode path[MAX_DEPTH];//根节点到当前节点的路径
+        int depth;//当前节点在path中的下标，-1表示没有数据
+};
+
+#endif
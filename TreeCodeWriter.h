@@ -0,0 +1,344 @@
+#ifndef _TREE_CODE_WRITER_H__
+#define _TREE_CODE_WRITER_H__
+
+#include "TreeCode.h"
+
+/*流式编码器：不建Node树，直接按TreeCode格式写出
+  beginNode写入节点并预留子节点数量，endNode时回填；
+  value相当于beginNode+endNode。输出与TreeCode::out逐字节相同，
+  节点类型和setObj的规则一致。
+  TC_FLAG_VARINT时子节点数量先预留3字节，endNode时改成最短编码并记下没用到的字节，
+  根节点结束时一次把这些空隙去掉，只移动一遍数据；调用者提供的内存需要能放下预留的字节。
+  输出可以放在调用者提供的内存中（写满时ok()返回false），
+  也可以放在内部缓冲中，完成后通过data()/size()或out(Stream&)取走
+  */
+class TreeCodeWriter
+{
+    public:
+        explicit TreeCodeWriter(unsigned char flags = 0)
+            :base(NULL),cap(0),len(0),fixed(false),good(true),flags(flags)
+        {
+            writeHeader();
+        }
+
+        TreeCodeWriter(void* dst,size_t cap,unsigned char flags = 0)
+            :base((char*)dst),cap(cap),len(0),fixed(true),good(true),flags(flags)
+        {
+            writeHeader();
+        }
+
+        //清空已写入的内容，重新开始
+        void reset()
+        {
+            len = 0;
+            good = true;
+            stack.clear();
+            gaps.clear();
+            writeHeader();
+        }
+
+        //开始一个空节点
+        void beginNode(const string& name)
+        {
+            beginSelf(name);
+            writeByte(Node::Empty);
+            beginSons();
+        }
+
+        //开始一个带内容的节点
+        template<typename T>
+            void beginNode(const string& name,const T& v)
+            {
+                beginSelf(name);
+                putValue(v);
+                beginSons();
+            }
+
+        //写一个没有子节点的节点
+        template<typename T>
+            void value(const string& name,const T& v)
+            {
+                beginNode(name,v);
+                endNode();
+            }
+
+        //结束当前节点，回填子节点数量（和子树长度）
+        void endNode()
+        {
+            if (stack.empty())
+            {
+                good = false;
+                return;
+            }
+            Open& o = stack.back();
+            if (good)
+            {
+                if (flags & TC_FLAG_VARINT)
+                {
+                    //按最短编码回填，预留中剩下的字节记为空隙，子树长度不计空隙
+                    unsigned char buf[10];
+                    size_t n = encodeVarint(o.sonNum,buf);
+                    memcpy(base + o.sonNumPos,buf,n);
+                    Gap& g = gaps[o.gap];
+                    g.pos = o.sonNumPos + n;
+                    g.size = VARINT_SON_NUM_SIZE - n;
+                    o.inner += g.size;
+                }
+                else
+                    memcpy(base + o.sonNumPos,&o.sonNum,sizeof(o.sonNum));
+                if (flags & TC_FLAG_SUBTREE_SIZE)
+                {
+                    unsigned int treeSize = len - o.begin - sizeof(treeSize) - o.inner;
+                    memcpy(base + o.begin,&treeSize,sizeof(treeSize));
+                }
+            }
+            size_t inner = o.inner;
+            stack.pop_back();
+            if (!stack.empty())
+                stack.back().inner += inner;
+            else if (good && !gaps.empty())
+                compact();
+        }
+
+        //所有节点都已结束且没有出错
+        bool finished() const
+        {
+            return good && stack.empty() && len > headerSize();
+        }
+
+        bool ok() const
+        {
+            return good;
+        }
+
+        const char* data() const
+        {
+            return base;
+        }
+
+        size_t size() const
+        {
+            return len;
+        }
+
+        //把编码结果写到Stream，只能在finished()后调用
+        bool out(Stream& st)
+        {
+            if (!finished())
+                return false;
+            st.write(base,len);
+            return true;
+        }
+
+        //追加原始字节，接口与Stream::write相同
+        void write(const char* p,size_t n)
+        {
+            if (!grow(n))
+                return;
+            memcpy(base + len,p,n);
+            len += n;
+        }
+
+    private:
+        enum { VARINT_SON_NUM_SIZE = 3 };//变长编码的子节点数量预留的字节数，足够65535
+
+        //打开的节点
+        struct Open
+        {
+            size_t begin;//节点起始位置
+            size_t sonNumPos;//子节点数量的位置
+            unsigned short sonNum;
+            size_t gap;//TC_FLAG_VARINT时子节点数量预留字节对应的空隙
+            size_t inner;//子树中（包括自己）还没去掉的空隙字节数
+        };
+
+        //子节点数量的预留中没用到的字节，位置按写入顺序递增
+        struct Gap
+        {
+            size_t pos;
+            size_t size;
+        };
+
+        //根节点结束后一次去掉全部空隙
+        void compact()
+        {
+            size_t out = gaps[0].pos;
+            for (size_t i=0;i<gaps.size();i++)
+            {
+                size_t from = gaps[i].pos + gaps[i].size;
+                size_t to = (i + 1 < gaps.size()) ? gaps[i + 1].pos : len;
+                memmove(base + out,base + from,to - from);
+                out += to - from;
+            }
+            len = out;
+            gaps.clear();
+        }
+
+        size_t headerSize() const
+        {
+            return flags != 0 ? TREECODE_HEADER_SIZE : 0;
+        }
+
+        void writeHeader()
+        {
+            //压缩和名称表需要完整的树，流式编码不支持
+            if (flags & ~TC_FLAG_RAW_MASK)
+            {
+                good = false;
+                return;
+            }
+            if (flags != 0)
+                writeTreeCodeHeader(*this,flags);
+        }
+
+        void beginSelf(const string& name)
+        {
+            if (!stack.empty())
+            {
+                Open& parent = stack.back();
+                if (parent.sonNum == 0xFFFF)
+                    good = false;
+                parent.sonNum++;
+            }
+            else if (len > headerSize())
+            {
+                good = false;//只能有一个根节点
+            }
+            if (name.size() > 255)
+                good = false;
+
+            Open o;
+            o.begin = len;
+            o.sonNumPos = 0;
+            o.sonNum = 0;
+            o.gap = 0;
+            o.inner = 0;
+            stack.push_back(o);
+
+            if (flags & TC_FLAG_SUBTREE_SIZE)
+                reserve(sizeof(unsigned int));
+            writeByte((unsigned char)name.size());
+            write(name.data(),name.size());
+        }
+
+        void beginSons()
+        {
+            Open& o = stack.back();
+            o.sonNumPos = len;
+            if (flags & TC_FLAG_VARINT)
+            {
+                Gap g = {len,0};
+                o.gap = gaps.size();
+                gaps.push_back(g);
+            }
+            reserve((flags & TC_FLAG_VARINT) ? (size_t)VARINT_SON_NUM_SIZE : sizeof(unsigned short));
+        }
+
+#define WRITER_VALUE(T,E) void putValue(T v){writeByte(E);write((const char*)&v,sizeof(v));}
+        WRITER_VALUE(bool,Node::Boolean)	WRITER_VALUE(char,Node::SByte)	WRITER_VALUE(unsigned char,Node::Byte)
+            WRITER_VALUE(short,Node::Int16)	WRITER_VALUE(unsigned short,Node::UInt16)
+            WRITER_VALUE(float,Node::Single)	WRITER_VALUE(double,Node::Double)	WRITER_VALUE(float2,Node::Vector2)
+            WRITER_VALUE(float3,Node::Vector3)	WRITER_VALUE(pos2,Node::Pos2)
+
+        //TC_FLAG_VARINT时变长编码的整数
+#define WRITER_VARINT(T,E) void putValue(T v){writeByte(E);if(flags & TC_FLAG_VARINT) writeVarint(*this,Node::toVarint(E,&v)); else write((const char*)&v,sizeof(v));}
+        WRITER_VARINT(int,Node::Int32)	WRITER_VARINT(unsigned int,Node::UInt32)	WRITER_VARINT(int64_t,Node::Int64)
+            WRITER_VARINT(uint64_t,Node::UInt64)
+
+        //数组，元素整块写入
+#define WRITER_ARRAY(T,E) void putValue(const TreeSpan<T>& v){writeByte(E);writeLength(v.size());if(v.size() > 0) write((const char*)v.data,(size_t)v.size() * sizeof(T));}
+        WRITER_ARRAY(int,Node::Int32Array)	WRITER_ARRAY(int64_t,Node::Int64Array)	WRITER_ARRAY(float,Node::SingleArray)
+            WRITER_ARRAY(double,Node::DoubleArray)	WRITER_ARRAY(float2,Node::Vector2Array)	WRITER_ARRAY(float3,Node::Vector3Array)
+            WRITER_ARRAY(pos2,Node::Pos2Array)
+
+        template<typename T>
+            void putValue(const vector<T>& v)
+            {
+                putValue(TreeSpan<T>(v.empty() ? NULL : &v[0],v.size()));
+            }
+
+        void putValue(const char* v)
+        {
+            putString(v,strlen(v));
+        }
+
+        void putValue(const string& v)
+        {
+            putString(v.data(),v.size());
+        }
+
+        void putValue(const buffer_t& v)
+        {
+            writeByte(Node::Buffer);
+            writeLength(v.len);
+            if (v.len > 0 && v.p != NULL)
+                write((const char*)v.p,v.len);
+        }
+
+        void putValue(const TreeBuffer& v)
+        {
+            writeByte(Node::Buffer);
+            writeLength(v.size());
+            write(v.data(),v.size());
+        }
+
+        void putString(const char* s,size_t n)
+        {
+            writeByte(Node::UTF8String);
+            writeLength(n);
+            write(s,n);
+        }
+
+        //字符串和buffer的长度
+        void writeLength(unsigned int n)
+        {
+            if (flags & TC_FLAG_VARINT)
+                writeVarint(*this,n);
+            else
+                write((const char*)&n,sizeof(n));
+        }
+
+        void writeByte(unsigned char b)
+        {
+            write((const char*)&b,1);
+        }
+
+        //预留n个字节，之后回填
+        void reserve(size_t n)
+        {
+            if (grow(n))
+                len += n;
+        }
+
+        bool grow(size_t n)
+        {
+            if (!good)
+                return false;
+            if (len + n <= cap)
+                return true;
+            if (fixed)
+            {
+                good = false;
+                return false;
+            }
+            size_t newCap = cap < 256 ? 256 : cap * 2;
+            while (newCap < len + n)
+                newCap *= 2;
+            own.resize(newCap);
+            base = &own[0];
+            cap = newCap;
+            return true;
+        }
+
+        char* base;
+        size_t cap;
+        size_t len;
+        bool fixed;//是否是调用者提供的内存
+        bool good;
+        unsigned char flags;
+        vector<char> own;//内部缓冲
+        vector<Open> stack;//还没结束的节点
+        vector<Gap> gaps;//TC_FLAG_VARINT时还没去掉的空隙
+};
+
+#endif